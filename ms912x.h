@@ -2,14 +2,29 @@
 #ifndef MS912X_H
 #define MS912X_H
 
+#include <linux/atomic.h>
+#include <linux/completion.h>
+#include <linux/hrtimer.h>
+#include <linux/kref.h>
+#include <linux/llist.h>
+#include <linux/ktime.h>
+#include <linux/scatterlist.h>
 #include <linux/usb.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 
+#include <drm/drm_connector.h>
 #include <drm/drm_device.h>
 #include <drm/drm_framebuffer.h>
 #include <drm/drm_gem.h>
+#include <drm/drm_gem_atomic_helper.h>
+#include <drm/drm_rect.h>
 #include <drm/drm_simple_kms_helper.h>
+#include <drm/drm_vblank.h>
 
+#include "ms912x_frame.h"
 #include "ms912x_regs.h" // FIX: include register definitions
 #define DRIVER_NAME "ms912x"
 #define DRIVER_DESC "MacroSilicon USB to VGA/HDMI"
@@ -21,16 +36,229 @@
 
 #define MS912X_TOTAL_URBS 8
 
+/* usb_device_id.driver_info flags */
+#define MS912X_HAS_RGB BIT(0) /* takes MS912X_PIXFMT_RGB frames */
+
+/* Scatterlist entries per URB for zero-copy sends, see ms912x_fb_send_sg() */
+#define MS912X_URB_SGS 32
+
+/* Damage rectangles tracked per queued frame before collapsing them */
+#define MS912X_MAX_CLIPS 8
+
+struct ms912x_device;
+struct ms912x_plane_state;
+
+/* One preallocated bulk URB with its coherent transfer buffer */
+struct ms912x_usb_request {
+	struct ms912x_device *ms912x;
+	struct urb *urb;
+	void *buf; /* coherent transfer buffer */
+	dma_addr_t dma;
+	struct list_head node;
+	ktime_t submitted_at;
+	struct scatterlist sg[MS912X_URB_SGS]; /* page backed, the HCD maps it */
+	u8 *sg_buf; /* header and end sequence of a zero-copy send */
+	struct ms912x_plane_state *plane; /* whose pages urb->sg reads */
+};
+
+enum ms912x_counter {
+	MS912X_STAT_FRAMES_COMMITTED,
+	MS912X_STAT_FRAMES_SENT,
+	MS912X_STAT_FRAMES_DROPPED, /* replaced in the mailbox before sending */
+	MS912X_STAT_FRAMES_FAILED,
+	MS912X_STAT_FRAMES_ZERO_COPY, /* sent straight from imported pages */
+	MS912X_STAT_FRAMES_DEFERRED, /* held back by the governor */
+	MS912X_STAT_FB_VMAPS, /* framebuffer mappings set up */
+	MS912X_STAT_MODESETS_SKIPPED, /* mode found still set on resume */
+	MS912X_STAT_BULK_BYTES,
+	MS912X_STAT_BULK_URBS,
+	MS912X_STAT_BULK_ERRORS,
+	MS912X_STAT_BULK_TIMEOUTS, /* no free URB or -ETIMEDOUT completion */
+	MS912X_STAT_CTRL_READ_STATUS,
+	MS912X_STAT_CTRL_READ_EDID,
+	MS912X_STAT_CTRL_READ_OTHER,
+	MS912X_STAT_COUNT
+};
+
+enum ms912x_hist {
+	MS912X_HIST_FRAME_BYTES,
+	MS912X_HIST_DAMAGE_AREA, /* pixels damaged per commit */
+	MS912X_HIST_CONVERT_US,
+	MS912X_HIST_URB_LATENCY_US, /* submit to completion */
+	MS912X_HIST_COUNT
+};
+
+/* Current values rather than totals, not cleared by a reset */
+enum ms912x_gauge {
+	MS912X_GAUGE_LINK_RATE, /* sustained bulk throughput, bytes/s */
+	MS912X_GAUGE_UPDATE_INTERVAL_US, /* governed time between frames */
+	MS912X_GAUGE_BACKLOG_BYTES, /* queued on the bus after a frame */
+	MS912X_GAUGE_COUNT
+};
+
+#define MS912X_HIST_BUCKETS 32
+
+/* Log2 histogram, bucket i counts values with i significant bits */
+struct ms912x_histogram {
+	u64 buckets[MS912X_HIST_BUCKETS];
+	u64 count;
+	u64 sum;
+	u64 max;
+};
+
+/* Pipeline statistics, see ms912x_stats.c */
+struct ms912x_stats {
+	atomic64_t counters[MS912X_STAT_COUNT];
+	atomic64_t reg_writes[256]; /* control writes per register */
+	atomic64_t gauges[MS912X_GAUGE_COUNT];
+	spinlock_t lock; /* protects hist */
+	struct ms912x_histogram hist[MS912X_HIST_COUNT];
+};
+
+struct ms912x_mode {
+	int width;
+	int height;
+	int hz;
+	int mode;
+	int pix_fmt;
+};
+
+/* Adaptive update rate, see ms912x_governor.c */
+struct ms912x_governor {
+	/* Protected by requests_lock */
+	u64 bytes_queued;
+	u64 bytes_done;
+	u64 sample_bytes; /* completed since the last rate update */
+	u64 sample_ns; /* bus busy time of sample_bytes */
+	ktime_t last_done;
+
+	/* Only touched by update_work */
+	u64 rate; /* bytes/s */
+	ktime_t next_frame;
+	bool holding; /* the pending frame is counted as deferred */
+};
+
+/* Adapters behind one host controller, see ms912x_sched.c */
+struct ms912x_bus_share {
+	struct list_head node;
+	struct usb_bus *bus;
+	unsigned int devices;
+	atomic64_t backlog; /* bytes queued and not yet completed */
+};
+
+/* Stripes a large update is converted in, see ms912x_stripes.c */
+#define MS912X_MAX_STRIPES 16
+
+/* One horizontal slice of an update, arguments of ms912x_encode_lines() */
+struct ms912x_stripe {
+	struct work_struct work;
+	struct completion done;
+	u8 *dst;
+	const void *src;
+	unsigned int pitch;
+	unsigned int fb_width;
+	u32 format;
+	unsigned int pix_fmt;
+	struct drm_rect rect;
+};
+
+/*
+ * Primary plane state.  The framebuffer is mapped in prepare_fb, or by the
+ * worker if it looked fit for zero-copy, and stays mapped until the state is
+ * freed.  A frame waiting in the mailbox, being encoded or being read by
+ * zero-copy URBs delays that by holding a reference.
+ */
+struct ms912x_plane_state {
+	struct drm_shadow_plane_state base;
+	struct kref ref;
+	struct llist_node free_node; /* see ms912x_plane_state_put_async() */
+	bool cursor_only; /* added by the cursor's atomic_check, unchanged */
+};
+
+#define to_ms912x_plane_state(s)                                               \
+	container_of(s, struct ms912x_plane_state, base.base)
+
+/* Single-slot hand-over from the commit path to the encode worker */
+struct ms912x_mailbox {
+	spinlock_t lock;
+	struct ms912x_plane_state *plane; /* newest frame, holds a reference */
+	struct drm_rect clips[MS912X_MAX_CLIPS]; /* damage since last send */
+	unsigned int num_clips;
+	unsigned int pix_fmt; /* MS912X_PIXFMT_* to encode plane's fb in */
+	struct drm_pending_vblank_event *event; /* flip to plane */
+	bool shadow_stale; /* device lost its contents, send in full */
+	struct ms912x_cursor cursor; /* newest cursor state */
+	bool cursor_image_dirty; /* cursor.image changed since taken */
+};
+
 struct ms912x_device {
         struct drm_device drm;
         struct usb_interface *intf;
         struct device *dmadev;
+        unsigned long flags; /* MS912X_HAS_* */
 
         struct drm_connector connector;
         struct drm_simple_display_pipe display_pipe;
+	struct work_struct init_work; /* warm-up after registration */
+	struct completion warmed_up;
+	struct drm_plane cursor_plane;
+
+	/* Connector state, see ms912x_connector.c */
+	const struct drm_edid *edid; /* cached until the status changes */
+	enum drm_connector_status status; /* debounced */
+	bool edid_burst;
+	struct delayed_work poll_work;
+	unsigned int poll_interval; /* ms */
+	enum drm_connector_status poll_pending;
+	unsigned int poll_count;
+	unsigned long poll_deferred; /* jiffies of the first skipped read */
+	struct urb *int_urb;
+	bool int_failed; /* int_urb stopped, the poller is on its own */
 
         /* Last mode set on the device */
         struct drm_display_mode mode;
+        unsigned int pix_fmt; /* MS912X_PIXFMT_* */
+	struct ms912x_mode hw_mode; /* as programmed, zeroed if unknown */
+	bool suspending;
+	bool resuming; /* the next enable may find hw_mode still set */
+	bool reset_resume; /* the device was reset while suspended */
+
+	/* Bulk URB pool, see ms912x_transfer.c */
+	struct ms912x_usb_request requests[MS912X_TOTAL_URBS];
+	struct list_head free_requests;
+	spinlock_t requests_lock;
+	wait_queue_head_t requests_wait;
+	struct usb_anchor submitted;
+	u64 urbs_submitted; /* protected by requests_lock */
+	u64 urbs_completed;
+	struct drm_pending_vblank_event *flip_event; /* after flip_seq URBs */
+	u64 flip_seq;
+	struct ms912x_governor governor;
+
+	/* Emulated vblank, see ms912x_vblank.c */
+	struct hrtimer vblank_timer;
+	ktime_t vblank_period;
+
+	/* Encode worker, see ms912x_update.c and ms912x_sched.c */
+	struct delayed_work update_work;
+	struct llist_head released_planes; /* by URB completions */
+	struct work_struct release_work;
+	struct ms912x_bus_share *bus_share;
+	int sched_slot;
+	int sched_cpu;
+	bool sched_waiting; /* for a URB to complete, under requests_lock */
+	struct ms912x_mailbox mailbox;
+
+	/* Encoder state, only touched by update_work */
+	void *encode_buf;
+	size_t encode_buf_size;
+	struct ms912x_shadow shadow;
+	struct ms912x_cursor cursor;
+	size_t frame_bytes; /* queued for the frame being sent */
+	u64 frame_convert_ns;
+	struct ms912x_stripe stripes[MS912X_MAX_STRIPES];
+
+	struct ms912x_stats stats;
 };
 
 struct ms912x_request {
@@ -57,25 +285,6 @@ struct ms912x_mode_request {
 	__be16 height;
 } __attribute__((packed));
 
-struct ms912x_frame_update_header {
-	__be16 header; /* ff 00 */
-	u8 x; /* left in multiple of 16 */
-	__be16 y;
-	u8 width; /* width in multiples of 16 */
-	__be16 height;
-} __attribute__((packed));
-
-struct ms912x_mode {
-	int width;
-	int height;
-	int hz;
-	int mode;
-	int pix_fmt;
-};
-
-#define MS912X_PIXFMT_UYVY 0x2200
-#define MS912X_PIXFMT_RGB 0x1100
-
 #define MS912X_MODE(w, h, z, m, f)                                             \
 	{                                                                      \
 		.width = w, .height = h, .hz = z, .mode = m, .pix_fmt = f      \
@@ -86,13 +295,116 @@ struct ms912x_mode {
 #define to_ms912x(x) container_of(x, struct ms912x_device, drm)
 
 int ms912x_read_byte(struct ms912x_device *ms912x, u16 address);
+int ms912x_read_bytes(struct ms912x_device *ms912x, u16 address, u8 *buf,
+		      size_t len, bool burst);
 int ms912x_connector_init(struct ms912x_device *ms912x);
+void ms912x_connector_prefetch(struct ms912x_device *ms912x);
+void ms912x_poll_start(struct ms912x_device *ms912x);
+void ms912x_poll_stop(struct ms912x_device *ms912x);
+bool ms912x_int_active(struct ms912x_device *ms912x);
 int ms912x_set_resolution(struct ms912x_device *ms912x,
 			  const struct ms912x_mode *mode);
+int ms912x_restore_resolution(struct ms912x_device *ms912x,
+			      const struct ms912x_mode *mode);
+bool ms912x_resolution_kept(struct ms912x_device *ms912x,
+			    const struct ms912x_mode *mode);
 
 int ms912x_power_on(struct ms912x_device *ms912x);
 int ms912x_power_off(struct ms912x_device *ms912x);
 
-int ms912x_transfer_framebuffer(struct ms912x_device *ms912x,
-                                const void *vaddr, size_t size);
+int ms912x_init_requests(struct ms912x_device *ms912x);
+void ms912x_free_requests(struct ms912x_device *ms912x);
+void ms912x_kill_requests(struct ms912x_device *ms912x);
+int ms912x_update_init(struct ms912x_device *ms912x);
+void ms912x_update_fini(struct ms912x_device *ms912x);
+void ms912x_stop_updates(struct ms912x_device *ms912x);
+void ms912x_post_frame(struct ms912x_device *ms912x,
+		       struct ms912x_plane_state *plane,
+		       const struct drm_rect *clips, unsigned int num_clips,
+		       struct drm_pending_vblank_event *event);
+void ms912x_post_cursor(struct ms912x_device *ms912x,
+			struct drm_plane_state *primary,
+			const struct drm_rect *rect, bool visible,
+			const void *image, unsigned int pitch,
+			struct drm_pending_vblank_event *event);
+void ms912x_invalidate_shadow(struct ms912x_device *ms912x);
+int ms912x_plane_state_vmap(struct ms912x_device *ms912x,
+			    struct ms912x_plane_state *state);
+void ms912x_plane_state_put(struct ms912x_plane_state *state);
+void ms912x_plane_state_put_async(struct ms912x_plane_state *state);
+
+int ms912x_cursor_init(struct ms912x_device *ms912x);
+
+int ms912x_sched_init(void);
+void ms912x_sched_exit(void);
+int ms912x_sched_attach(struct ms912x_device *ms912x);
+void ms912x_sched_detach(struct ms912x_device *ms912x);
+void ms912x_sched_queue(struct ms912x_device *ms912x, unsigned long delay);
+void ms912x_sched_queue_stripe(struct work_struct *work);
+bool ms912x_sched_over_share(struct ms912x_device *ms912x);
+
+void ms912x_stripes_init(struct ms912x_device *ms912x);
+unsigned int ms912x_stripes_count(struct ms912x_device *ms912x,
+				  const struct drm_rect *rect);
+void ms912x_stripe_set(struct ms912x_device *ms912x, unsigned int i, u8 *dst,
+		       const void *src, struct drm_framebuffer *fb,
+		       unsigned int pix_fmt, const struct drm_rect *rect);
+void ms912x_stripes_run(struct ms912x_device *ms912x, unsigned int n);
+void ms912x_encode_stripes(struct ms912x_device *ms912x, u8 *dst,
+			   const void *src, struct drm_framebuffer *fb,
+			   unsigned int pix_fmt, const struct drm_rect *rect,
+			   unsigned int n);
+
+int ms912x_fb_send_rect(struct ms912x_device *ms912x,
+			struct drm_framebuffer *fb, const void *vaddr,
+			struct drm_rect *rect);
+struct sg_table *ms912x_fb_zero_copy_sgt(struct ms912x_device *ms912x,
+					 struct drm_framebuffer *fb);
+int ms912x_fb_send_sg(struct ms912x_device *ms912x,
+		      struct ms912x_plane_state *plane, struct sg_table *sgt,
+		      struct drm_rect *rect);
+void ms912x_queue_flip(struct ms912x_device *ms912x,
+		       struct drm_pending_vblank_event *event);
+
+int ms912x_vblank_init(struct ms912x_device *ms912x);
+void ms912x_vblank_fini(struct ms912x_device *ms912x);
+void ms912x_vblank_set_rate(struct ms912x_device *ms912x, int hz);
+int ms912x_enable_vblank(struct drm_simple_display_pipe *pipe);
+void ms912x_disable_vblank(struct drm_simple_display_pipe *pipe);
+void ms912x_send_vblank_event(struct ms912x_device *ms912x,
+			      struct drm_pending_vblank_event *event);
+
+void ms912x_stats_init(struct ms912x_stats *stats);
+void ms912x_stats_reset(struct ms912x_stats *stats);
+void ms912x_stats_hist(struct ms912x_stats *stats, enum ms912x_hist hist,
+		       u64 value);
+
+static inline void ms912x_stats_add(struct ms912x_stats *stats,
+				    enum ms912x_counter counter, s64 value)
+{
+	atomic64_add(value, &stats->counters[counter]);
+}
+
+static inline void ms912x_stats_inc(struct ms912x_stats *stats,
+				    enum ms912x_counter counter)
+{
+	atomic64_inc(&stats->counters[counter]);
+}
+
+static inline void ms912x_stats_set(struct ms912x_stats *stats,
+				    enum ms912x_gauge gauge, s64 value)
+{
+	atomic64_set(&stats->gauges[gauge], value);
+}
+
+void ms912x_governor_done(struct ms912x_governor *gov,
+			  struct ms912x_usb_request *request, ktime_t now);
+void ms912x_governor_frame_sent(struct ms912x_device *ms912x, ktime_t start);
+unsigned long ms912x_governor_delay(struct ms912x_device *ms912x);
+
+#if defined(CONFIG_DEBUG_FS)
+struct drm_minor;
+void ms912x_debugfs_init(struct drm_minor *minor);
+#endif
+
 #endif // MS912X_H
@@ -2,6 +2,7 @@
 #define MS912X_COMPAT_H
 
 #include <linux/version.h>
+#include <linux/hrtimer.h>
 #include <linux/timer.h>
 #include <linux/container_of.h> /* container_of for helpers */
 #include <linux/workqueue.h>    /* still used elsewhere */
@@ -21,6 +22,26 @@ static inline void ms912x_shutdown_timer(struct timer_list *timer)
         timer_shutdown_sync(timer);
 }
 
+/* hrtimer_setup() replaced hrtimer_init() plus assigning the callback */
+static inline void
+ms912x_hrtimer_setup(struct hrtimer *timer,
+                     enum hrtimer_restart (*function)(struct hrtimer *),
+                     clockid_t clock_id, enum hrtimer_mode mode)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+        hrtimer_setup(timer, function, clock_id, mode);
+#else
+        hrtimer_init(timer, clock_id, mode);
+        timer->function = function;
+#endif
+}
+
+/* struct usb_driver embeds its struct device_driver directly since 6.8 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+#define MS912X_USB_PROBE_TYPE(type) .driver.probe_type = (type)
+#else
+#define MS912X_USB_PROBE_TYPE(type) .drvwrap.driver.probe_type = (type)
+#endif
 
 /* REPLACEMENT: wrapper for fbdev setup so driver builds without drm_fbdev_generic */
 #if __has_include(<drm/drm_fbdev_generic.h>)
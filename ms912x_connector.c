@@ -1,50 +1,106 @@
 
+#include <linux/module.h>
+#include <linux/usb.h>
+#include <linux/workqueue.h>
+
 #include <drm/drm_atomic_state_helper.h>
 #include <drm/drm_connector.h>
 #include <drm/drm_edid.h>
 #include <drm/drm_modeset_helper_vtables.h>
+#include <drm/drm_print.h>
 #include <drm/drm_probe_helper.h>
 
 #include "ms912x.h"
+#include "ms912x_trace.h"
+
+static bool edid_burst = true;
+module_param(edid_burst, bool, 0444);
+MODULE_PARM_DESC(edid_burst, "Read several EDID bytes per register read (default: true)");
+
+static unsigned int poll_max_ms = 8000;
+module_param(poll_max_ms, uint, 0644);
+MODULE_PARM_DESC(poll_max_ms, "Longest hotplug poll interval while the status is stable, in ms (default: 8000)");
+
+/* Fast re-check interval right after a change and while debouncing */
+#define MS912X_POLL_MIN_MS 250
+/* First interval once the status is stable, doubled up to poll_max_ms */
+#define MS912X_POLL_STABLE_MS 1000
+/* Identical reads needed before a new status is reported */
+#define MS912X_POLL_DEBOUNCE 3
 
+static bool ms912x_edid_block_valid(const u8 *buf, size_t len,
+				    unsigned int block)
+{
+	static const u8 header[] = { 0x00, 0xff, 0xff, 0xff,
+				     0xff, 0xff, 0xff, 0x00 };
+	u8 sum = 0;
+	size_t i;
+
+	if (len != EDID_LENGTH)
+		return true;
+	if (block == 0 && memcmp(buf, header, sizeof(header)))
+		return false;
+
+	for (i = 0; i < len; i++)
+		sum += buf[i];
+	return sum == 0;
+}
+
+/*
+ * Burst reads take the registers following the requested one from the same
+ * reply.  If that yields a block that does not validate, the device does not
+ * behave that way and we fall back to one register per read for good.
+ */
 static int ms912x_read_edid(void *data, u8 *buf, unsigned int block, size_t len)
 {
 	struct ms912x_device *ms912x = data;
-	int offset = block * EDID_LENGTH;
-	int i, ret;
-        for (i = 0; i < len; i++) {
-                u16 address = MS912X_REG_EDID_BASE + offset + i; // FIX: use register macro
-                ret = ms912x_read_byte(ms912x, address);
-                if (ret < 0)
-                        return ret;
-                buf[i] = ret;
-        }
-        return 0;
+	u16 address = MS912X_REG_EDID_BASE + block * EDID_LENGTH; // FIX: use register macro
+	int ret;
+
+	trace_ms912x_edid_read_begin(ms912x, block, len, 0);
+
+	if (ms912x->edid_burst) {
+		ret = ms912x_read_bytes(ms912x, address, buf, len, true);
+		if (ret || ms912x_edid_block_valid(buf, len, block))
+			goto out;
+
+		drm_dbg_kms(&ms912x->drm,
+			    "burst EDID read invalid, using single reads\n");
+		ms912x->edid_burst = false;
+	}
+
+	ret = ms912x_read_bytes(ms912x, address, buf, len, false);
+out:
+	trace_ms912x_edid_read_end(ms912x, block, len, ret);
+	return ret;
+}
+
+static void ms912x_edid_invalidate(struct ms912x_device *ms912x)
+{
+	drm_edid_free(ms912x->edid);
+	ms912x->edid = NULL;
 }
 
 static int ms912x_connector_get_modes(struct drm_connector *connector)
 {
 	int ret;
 	struct ms912x_device *ms912x = to_ms912x(connector->dev);
-	const struct drm_edid *edid;
-	edid = drm_edid_read_custom(connector, ms912x_read_edid, ms912x);
-	if (!edid)
-		return 0;
-	ret = drm_edid_connector_update(connector, edid);
-	if (ret < 0) {
-		ret = 0;
-		goto edid_free;
+
+	if (!ms912x->edid && !usb_autopm_get_interface(ms912x->intf)) {
+		ms912x->edid = drm_edid_read_custom(connector, ms912x_read_edid,
+						    ms912x);
+		usb_autopm_put_interface(ms912x->intf);
 	}
-	ret = drm_edid_connector_add_modes(connector);
-edid_free:
-	drm_edid_free(edid);
-	return ret;
+	if (!ms912x->edid)
+		return 0;
+	ret = drm_edid_connector_update(connector, ms912x->edid);
+	if (ret < 0)
+		return 0;
+	return drm_edid_connector_add_modes(connector);
 }
 
-static enum drm_connector_status ms912x_detect(struct drm_connector *connector,
-					       bool force)
+static enum drm_connector_status ms912x_read_status(struct ms912x_device *ms912x)
 {
-	struct ms912x_device *ms912x = to_ms912x(connector->dev);
         int status = ms912x_read_byte(ms912x, MS912X_REG_STATUS); // FIX: use register macro
 
 	if (status < 0)
@@ -53,13 +109,287 @@ static enum drm_connector_status ms912x_detect(struct drm_connector *connector,
 	return status == 1 ? connector_status_connected :
 			     connector_status_disconnected;
 }
+
+/* Called with mode_config.mutex held */
+static void ms912x_set_status(struct ms912x_device *ms912x,
+			      enum drm_connector_status status)
+{
+	/* A monitor may have been swapped, re-read the EDID next time */
+	if (status != ms912x->status) {
+		ms912x_edid_invalidate(ms912x);
+		ms912x->status = status;
+	}
+}
+
+/*
+ * The poller below owns the status register, so probes from userspace
+ * only read it when no debounced status is known yet.
+ */
+static enum drm_connector_status ms912x_detect(struct drm_connector *connector,
+					       bool force)
+{
+	struct ms912x_device *ms912x = to_ms912x(connector->dev);
+	enum drm_connector_status status;
+
+	if (ms912x->status != connector_status_unknown)
+		return ms912x->status;
+
+	if (usb_autopm_get_interface(ms912x->intf))
+		return connector_status_unknown;
+	status = ms912x_read_status(ms912x);
+	usb_autopm_put_interface(ms912x->intf);
+	if (status != connector_status_unknown)
+		ms912x_set_status(ms912x, status);
+
+	return status;
+}
+
+static unsigned int ms912x_poll_limit(void)
+{
+	return max_t(unsigned int, READ_ONCE(poll_max_ms),
+		     MS912X_POLL_STABLE_MS);
+}
+
+static unsigned int ms912x_poll_next(struct ms912x_device *ms912x)
+{
+	unsigned int limit = ms912x_poll_limit();
+
+	/* With an interrupt endpoint, polling is only a safety net */
+	if (ms912x_int_active(ms912x))
+		return limit;
+
+	if (ms912x->poll_interval < MS912X_POLL_STABLE_MS)
+		return MS912X_POLL_STABLE_MS;
+	return min(ms912x->poll_interval * 2, limit);
+}
+
+/*
+ * Adaptive hotplug poll.  Backs off while the status is stable, re-checks
+ * quickly after a change and only reports a new status once it has been
+ * read MS912X_POLL_DEBOUNCE times in a row.  Skipped while frame data is on
+ * the bus, so control traffic never competes with an update, but for no
+ * longer than the longest poll interval so streaming cannot hide a hotplug.
+ */
+static void ms912x_poll_work(struct work_struct *work)
+{
+	struct ms912x_device *ms912x =
+		container_of(to_delayed_work(work), struct ms912x_device,
+			     poll_work);
+	struct drm_device *dev = &ms912x->drm;
+	enum drm_connector_status status;
+	bool changed = false;
+
+	if (!usb_anchor_empty(&ms912x->submitted)) {
+		if (!ms912x->poll_deferred)
+			ms912x->poll_deferred = jiffies;
+		if (time_before(jiffies, ms912x->poll_deferred +
+				msecs_to_jiffies(ms912x_poll_limit()))) {
+			ms912x->poll_interval = MS912X_POLL_MIN_MS;
+			goto out;
+		}
+	}
+	ms912x->poll_deferred = 0;
+
+	status = ms912x_read_status(ms912x);
+	if (status == connector_status_unknown) {
+		ms912x->poll_interval = ms912x_poll_next(ms912x);
+		goto out;
+	}
+
+	if (status == ms912x->status) {
+		ms912x->poll_count = 0;
+		ms912x->poll_interval = ms912x_poll_next(ms912x);
+		goto out;
+	}
+
+	if (status != ms912x->poll_pending) {
+		ms912x->poll_pending = status;
+		ms912x->poll_count = 0;
+	}
+	ms912x->poll_interval = MS912X_POLL_MIN_MS;
+
+	if (++ms912x->poll_count < MS912X_POLL_DEBOUNCE &&
+	    ms912x->status != connector_status_unknown)
+		goto out;
+
+	mutex_lock(&dev->mode_config.mutex);
+	ms912x_set_status(ms912x, status);
+	mutex_unlock(&dev->mode_config.mutex);
+	ms912x->poll_count = 0;
+	changed = true;
+
+out:
+	if (changed)
+		drm_kms_helper_hotplug_event(dev);
+
+	queue_delayed_work(system_wq, &ms912x->poll_work,
+			   msecs_to_jiffies(ms912x->poll_interval));
+}
+
+/**
+ * ms912x_int_active - whether hotplug reports come from the interrupt endpoint
+ * @ms912x: device handle
+ */
+bool ms912x_int_active(struct ms912x_device *ms912x)
+{
+	return ms912x->int_urb && !READ_ONCE(ms912x->int_failed);
+}
+
+/* Leaves hotplug to the poller until ms912x_poll_start() tries again */
+static void ms912x_int_fail(struct ms912x_device *ms912x)
+{
+	WRITE_ONCE(ms912x->int_failed, true);
+	mod_delayed_work(system_wq, &ms912x->poll_work, 0);
+}
+
+static void ms912x_int_complete(struct urb *urb)
+{
+	struct ms912x_device *ms912x = urb->context;
+	int ret;
+
+	switch (urb->status) {
+	case 0:
+		/* Report format is unknown, just re-check the status now */
+		mod_delayed_work(system_wq, &ms912x->poll_work, 0);
+		break;
+	case -ENOENT:
+	case -ECONNRESET:
+	case -ESHUTDOWN:
+		return;
+	case -EPROTO:
+	case -EILSEQ:
+	case -ETIME:
+	case -EPIPE:
+		/* Would fail again right away, a bad cable or an unplug */
+		drm_dbg_kms(&ms912x->drm, "interrupt endpoint error %d\n",
+			    urb->status);
+		ms912x_int_fail(ms912x);
+		return;
+	default:
+		break;
+	}
+
+	ret = usb_submit_urb(urb, GFP_ATOMIC);
+	if (ret) {
+		dev_warn_ratelimited(&ms912x->intf->dev,
+				     "interrupt resubmit failed: %d\n", ret);
+		ms912x_int_fail(ms912x);
+	}
+}
+
+static void ms912x_int_init(struct ms912x_device *ms912x)
+{
+	struct usb_device *udev = interface_to_usbdev(ms912x->intf);
+	struct usb_endpoint_descriptor *ep;
+	u8 *buf;
+
+	if (usb_find_int_in_endpoint(ms912x->intf->cur_altsetting, &ep))
+		return;
+
+	ms912x->int_urb = usb_alloc_urb(0, GFP_KERNEL);
+	buf = kmalloc(usb_endpoint_maxp(ep), GFP_KERNEL);
+	if (!ms912x->int_urb || !buf) {
+		usb_free_urb(ms912x->int_urb);
+		ms912x->int_urb = NULL;
+		kfree(buf);
+		return;
+	}
+
+	usb_fill_int_urb(ms912x->int_urb, udev,
+			 usb_rcvintpipe(udev, ep->bEndpointAddress), buf,
+			 usb_endpoint_maxp(ep), ms912x_int_complete, ms912x,
+			 ep->bInterval);
+	ms912x->int_urb->transfer_flags |= URB_FREE_BUFFER;
+	drm_dbg_kms(&ms912x->drm, "using interrupt endpoint %02x for hotplug\n",
+		    ep->bEndpointAddress);
+}
+
+/**
+ * ms912x_connector_prefetch - read status and EDID ahead of the first probe
+ * @ms912x: device handle
+ *
+ * Called from the warm-up worker, so the round trips to the adapter are
+ * done by the time a client probes the connector.  A status the poller or
+ * a probe found meanwhile is kept.
+ */
+void ms912x_connector_prefetch(struct ms912x_device *ms912x)
+{
+	struct drm_device *dev = &ms912x->drm;
+	const struct drm_edid *edid = NULL;
+	enum drm_connector_status status;
+
+	status = ms912x_read_status(ms912x);
+	if (status == connector_status_connected)
+		edid = drm_edid_read_custom(&ms912x->connector,
+					    ms912x_read_edid, ms912x);
+
+	mutex_lock(&dev->mode_config.mutex);
+	if (status != connector_status_unknown &&
+	    ms912x->status == connector_status_unknown) {
+		ms912x_set_status(ms912x, status);
+		if (!ms912x->edid) {
+			ms912x->edid = edid;
+			edid = NULL;
+		}
+	}
+	mutex_unlock(&dev->mode_config.mutex);
+
+	drm_edid_free(edid);
+}
+
+/**
+ * ms912x_poll_start - start hotplug detection
+ * @ms912x: device handle
+ */
+void ms912x_poll_start(struct ms912x_device *ms912x)
+{
+	int ret;
+
+	ms912x->poll_interval = MS912X_POLL_MIN_MS;
+	ms912x->poll_count = 0;
+	ms912x->poll_deferred = 0;
+	ms912x->int_failed = false;
+
+	if (ms912x->int_urb) {
+		ret = usb_submit_urb(ms912x->int_urb, GFP_KERNEL);
+		if (ret) {
+			drm_warn(&ms912x->drm,
+				 "interrupt endpoint unusable: %d\n", ret);
+			ms912x->int_failed = true;
+		}
+	}
+
+	queue_delayed_work(system_wq, &ms912x->poll_work, 0);
+}
+
+/**
+ * ms912x_poll_stop - stop hotplug detection
+ * @ms912x: device handle
+ */
+void ms912x_poll_stop(struct ms912x_device *ms912x)
+{
+	if (ms912x->int_urb)
+		usb_kill_urb(ms912x->int_urb);
+	cancel_delayed_work_sync(&ms912x->poll_work);
+}
+
+static void ms912x_connector_destroy(struct drm_connector *connector)
+{
+	struct ms912x_device *ms912x = to_ms912x(connector->dev);
+
+	ms912x_edid_invalidate(ms912x);
+	usb_free_urb(ms912x->int_urb);
+	ms912x->int_urb = NULL;
+	drm_connector_cleanup(connector);
+}
+
 static const struct drm_connector_helper_funcs ms912x_connector_helper_funcs = {
 	.get_modes = ms912x_connector_get_modes,
 };
 
 static const struct drm_connector_funcs ms912x_connector_funcs = {
 	.fill_modes = drm_helper_probe_single_connector_modes,
-	.destroy = drm_connector_cleanup,
+	.destroy = ms912x_connector_destroy,
 	.detect = ms912x_detect,
 	.reset = drm_atomic_helper_connector_reset,
 	.atomic_duplicate_state = drm_atomic_helper_connector_duplicate_state,
@@ -69,12 +399,22 @@ static const struct drm_connector_funcs ms912x_connector_funcs = {
 int ms912x_connector_init(struct ms912x_device *ms912x)
 {
 	int ret;
+
+	ms912x->status = connector_status_unknown;
+	ms912x->poll_pending = connector_status_unknown;
+	ms912x->edid_burst = edid_burst;
+	INIT_DELAYED_WORK(&ms912x->poll_work, ms912x_poll_work);
+
 	drm_connector_helper_add(&ms912x->connector,
 				 &ms912x_connector_helper_funcs);
 	ret = drm_connector_init(&ms912x->drm, &ms912x->connector,
 				 &ms912x_connector_funcs,
 				 DRM_MODE_CONNECTOR_HDMIA);
-	ms912x->connector.polled =
-		DRM_CONNECTOR_POLL_CONNECT | DRM_CONNECTOR_POLL_DISCONNECT;
-	return ret;
+	if (ret)
+		return ret;
+
+	/* Hotplug events come from ms912x_poll_work() */
+	ms912x->connector.polled = DRM_CONNECTOR_POLL_HPD;
+	ms912x_int_init(ms912x);
+	return 0;
 }
@@ -0,0 +1,438 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+
+#if defined(CONFIG_X86)
+#include <asm/cpufeature.h>
+#include <asm/fpu/api.h>
+#elif defined(CONFIG_ARM64)
+#include <asm/cpufeature.h>
+#include <asm/neon.h>
+#endif
+#include <asm/simd.h>
+
+#include <drm/drm_fourcc.h>
+
+#include "ms912x_convert.h"
+
+static bool simd = true;
+module_param(simd, bool, 0444);
+MODULE_PARM_DESC(simd, "Use SIMD colour conversion when the CPU supports it (default: true)");
+
+static ms912x_line_fn ms912x_xrgb8888_to_uyvy_simd __read_mostly;
+
+static inline u8 ms912x_rgb_to_y(int r, int g, int b)
+{
+	return 16 + ((66 * r + 129 * g + 25 * b + 128) >> 8);
+}
+
+static inline u8 ms912x_rgb_to_u(int r, int g, int b)
+{
+	return 128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8);
+}
+
+static inline u8 ms912x_rgb_to_v(int r, int g, int b)
+{
+	return 128 + ((112 * r - 94 * g - 18 * b + 128) >> 8);
+}
+
+/* One UYVY macropixel, chroma from the truncated average of the pair */
+static inline void ms912x_rgb_pair_to_uyvy(u8 *dst, int r0, int g0, int b0,
+					   int r1, int g1, int b1)
+{
+	dst[0] = ms912x_rgb_to_u((r0 + r1) / 2, (g0 + g1) / 2, (b0 + b1) / 2);
+	dst[1] = ms912x_rgb_to_y(r0, g0, b0);
+	dst[2] = ms912x_rgb_to_v((r0 + r1) / 2, (g0 + g1) / 2, (b0 + b1) / 2);
+	dst[3] = ms912x_rgb_to_y(r1, g1, b1);
+}
+
+/**
+ * ms912x_xrgb8888_to_uyvy_line_c - scalar reference conversion
+ * @dst:   UYVY output, 2 bytes per pixel rounded up to a pixel pair
+ * @src:   XRGB8888 input
+ * @width: number of pixels
+ *
+ * BT.601 limited range.  Chroma is taken from the average of each pixel
+ * pair; an odd trailing pixel is paired with itself.
+ */
+void ms912x_xrgb8888_to_uyvy_line_c(u8 *dst, const u32 *src,
+				    unsigned int width)
+{
+	unsigned int x;
+	u32 p0, p1;
+
+	for (x = 0; x < width; x += 2, dst += 4) {
+		p0 = src[x];
+		p1 = x + 1 < width ? src[x + 1] : p0;
+
+		ms912x_rgb_pair_to_uyvy(dst, (p0 >> 16) & 0xff,
+					(p0 >> 8) & 0xff, p0 & 0xff,
+					(p1 >> 16) & 0xff, (p1 >> 8) & 0xff,
+					p1 & 0xff);
+	}
+}
+
+/* As above with red and blue swapped */
+static void ms912x_xbgr8888_to_uyvy_line_c(u8 *dst, const u32 *src,
+					   unsigned int width)
+{
+	unsigned int x;
+	u32 p0, p1;
+
+	for (x = 0; x < width; x += 2, dst += 4) {
+		p0 = src[x];
+		p1 = x + 1 < width ? src[x + 1] : p0;
+
+		ms912x_rgb_pair_to_uyvy(dst, p0 & 0xff, (p0 >> 8) & 0xff,
+					(p0 >> 16) & 0xff, p1 & 0xff,
+					(p1 >> 8) & 0xff, (p1 >> 16) & 0xff);
+	}
+}
+
+/* Channels are widened to 8 bits by replicating their top bits */
+static void ms912x_rgb565_to_uyvy_line_c(u8 *dst, const u16 *src,
+					 unsigned int width)
+{
+	unsigned int x;
+	u16 p0, p1;
+	int r0, g0, b0, r1, g1, b1;
+
+	for (x = 0; x < width; x += 2, dst += 4) {
+		p0 = src[x];
+		p1 = x + 1 < width ? src[x + 1] : p0;
+
+		r0 = (p0 >> 11) & 0x1f;
+		g0 = (p0 >> 5) & 0x3f;
+		b0 = p0 & 0x1f;
+		r1 = (p1 >> 11) & 0x1f;
+		g1 = (p1 >> 5) & 0x3f;
+		b1 = p1 & 0x1f;
+
+		ms912x_rgb_pair_to_uyvy(dst, r0 << 3 | r0 >> 2, g0 << 2 | g0 >> 4,
+					b0 << 3 | b0 >> 2, r1 << 3 | r1 >> 2,
+					g1 << 2 | g1 >> 4, b1 << 3 | b1 >> 2);
+	}
+}
+
+/* Same samples as UYVY, only the byte order within each half differs */
+static void ms912x_yuyv_to_uyvy_line(u8 *dst, const u8 *src,
+				     unsigned int width)
+{
+	unsigned int x;
+	u32 v;
+
+	for (x = 0; x < width; x += 2, src += 4, dst += 4) {
+		memcpy(&v, src, sizeof(v));
+		v = (v & 0x00ff00ff) << 8 | (v >> 8 & 0x00ff00ff);
+		memcpy(dst, &v, sizeof(v));
+	}
+}
+
+static ms912x_line_fn ms912x_select_simd(const char **name)
+{
+#if defined(CONFIG_X86)
+	if (boot_cpu_has(X86_FEATURE_AVX2) && boot_cpu_has(X86_FEATURE_AVX) &&
+	    cpu_has_xfeatures(XFEATURE_MASK_SSE | XFEATURE_MASK_YMM, NULL)) {
+		*name = "avx2";
+		return ms912x_xrgb8888_to_uyvy_line_avx2;
+	}
+	if (boot_cpu_has(X86_FEATURE_XMM2)) {
+		*name = "sse2";
+		return ms912x_xrgb8888_to_uyvy_line_sse2;
+	}
+#elif defined(CONFIG_ARM64)
+	if (cpu_have_named_feature(ASIMD)) {
+		*name = "neon";
+		return ms912x_xrgb8888_to_uyvy_line_neon;
+	}
+#endif
+	return NULL;
+}
+
+static const char *ms912x_convert_variant = "scalar";
+
+/**
+ * ms912x_convert_init - pick the conversion kernels for this CPU
+ *
+ * Called once at module load.  Returns the name of the selected variant.
+ */
+const char *ms912x_convert_init(void)
+{
+	const char *name = "scalar";
+
+	ms912x_xrgb8888_to_uyvy_simd = simd ? ms912x_select_simd(&name) : NULL;
+	ms912x_convert_variant = name;
+	return name;
+}
+
+/**
+ * ms912x_convert_name - name of the variant ms912x_convert_init() picked
+ */
+const char *ms912x_convert_name(void)
+{
+	return ms912x_convert_variant;
+}
+
+static inline bool ms912x_convert_begin(void)
+{
+	if (!ms912x_xrgb8888_to_uyvy_simd || !may_use_simd())
+		return false;
+
+#if defined(CONFIG_X86)
+	kernel_fpu_begin();
+#elif defined(CONFIG_ARM64)
+	kernel_neon_begin();
+#endif
+	return true;
+}
+
+static inline void ms912x_convert_end(void)
+{
+#if defined(CONFIG_X86)
+	kernel_fpu_end();
+#elif defined(CONFIG_ARM64)
+	kernel_neon_end();
+#endif
+}
+
+/**
+ * ms912x_xrgb8888_to_uyvy_line - convert one line with the best kernel
+ * @dst:   UYVY output
+ * @src:   XRGB8888 input
+ * @width: number of pixels
+ *
+ * The FPU section covers a single line so preemption is never held off for
+ * longer than one line takes to convert.
+ */
+void ms912x_xrgb8888_to_uyvy_line(u8 *dst, const u32 *src, unsigned int width)
+{
+	if (!ms912x_convert_begin()) {
+		ms912x_xrgb8888_to_uyvy_line_c(dst, src, width);
+		return;
+	}
+
+	ms912x_xrgb8888_to_uyvy_simd(dst, src, width);
+	ms912x_convert_end();
+}
+
+/**
+ * ms912x_format_cpp - bytes per pixel of a supported framebuffer format
+ * @format: DRM fourcc
+ *
+ * Returns 0 if ms912x_line_to_uyvy() cannot handle @format.
+ */
+unsigned int ms912x_format_cpp(u32 format)
+{
+	switch (format) {
+	case DRM_FORMAT_XRGB8888:
+	case DRM_FORMAT_ARGB8888:
+	case DRM_FORMAT_XBGR8888:
+		return 4;
+	case DRM_FORMAT_RGB565:
+	case DRM_FORMAT_UYVY:
+	case DRM_FORMAT_YUYV:
+		return 2;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * ms912x_line_to_uyvy - bring one line of a framebuffer into device format
+ * @dst:    UYVY output
+ * @src:    input in @format
+ * @width:  number of pixels, even for the 4:2:2 formats
+ * @format: DRM fourcc, one that ms912x_format_cpp() accepts
+ *
+ * 4:2:2 input is copied through without touching the samples.  Alpha is
+ * ignored, the primary plane is always opaque.
+ */
+void ms912x_line_to_uyvy(u8 *dst, const void *src, unsigned int width,
+			 u32 format)
+{
+	switch (format) {
+	case DRM_FORMAT_XRGB8888:
+	case DRM_FORMAT_ARGB8888:
+		ms912x_xrgb8888_to_uyvy_line(dst, src, width);
+		break;
+	case DRM_FORMAT_XBGR8888:
+		ms912x_xbgr8888_to_uyvy_line_c(dst, src, width);
+		break;
+	case DRM_FORMAT_RGB565:
+		ms912x_rgb565_to_uyvy_line_c(dst, src, width);
+		break;
+	case DRM_FORMAT_UYVY:
+		memcpy(dst, src, width * 2);
+		break;
+	case DRM_FORMAT_YUYV:
+		ms912x_yuyv_to_uyvy_line(dst, src, width);
+		break;
+	}
+}
+
+static inline void ms912x_put_rgb(u8 *dst, int r, int g, int b)
+{
+	dst[0] = r;
+	dst[1] = g;
+	dst[2] = b;
+}
+
+static void ms912x_xrgb8888_to_rgb_line(u8 *dst, const u32 *src,
+					unsigned int width)
+{
+	unsigned int x;
+
+	for (x = 0; x < width; x++, dst += 3)
+		ms912x_put_rgb(dst, (src[x] >> 16) & 0xff,
+			       (src[x] >> 8) & 0xff, src[x] & 0xff);
+}
+
+static void ms912x_xbgr8888_to_rgb_line(u8 *dst, const u32 *src,
+					unsigned int width)
+{
+	unsigned int x;
+
+	for (x = 0; x < width; x++, dst += 3)
+		ms912x_put_rgb(dst, src[x] & 0xff, (src[x] >> 8) & 0xff,
+			       (src[x] >> 16) & 0xff);
+}
+
+static void ms912x_rgb565_to_rgb_line(u8 *dst, const u16 *src,
+				      unsigned int width)
+{
+	unsigned int x;
+	int r, g, b;
+
+	for (x = 0; x < width; x++, dst += 3) {
+		r = (src[x] >> 11) & 0x1f;
+		g = (src[x] >> 5) & 0x3f;
+		b = src[x] & 0x1f;
+		ms912x_put_rgb(dst, r << 3 | r >> 2, g << 2 | g >> 4,
+			       b << 3 | b >> 2);
+	}
+}
+
+/* BT.601 limited range back to RGB, @d and @e are the centred chroma */
+static inline void ms912x_yuv_to_rgb(u8 *dst, int y, int d, int e)
+{
+	int c = 298 * (y - 16);
+
+	ms912x_put_rgb(dst, clamp_t(int, (c + 409 * e + 128) >> 8, 0, 255),
+		       clamp_t(int, (c - 100 * d - 208 * e + 128) >> 8, 0, 255),
+		       clamp_t(int, (c + 516 * d + 128) >> 8, 0, 255));
+}
+
+/* @y0 and @y1 share the chroma, @y1 is dropped for an odd trailing pixel */
+static inline void ms912x_yuv_pair_to_rgb(u8 *dst, int y0, int y1, int u,
+					  int v, bool odd)
+{
+	ms912x_yuv_to_rgb(dst, y0, u - 128, v - 128);
+	if (!odd)
+		ms912x_yuv_to_rgb(dst + 3, y1, u - 128, v - 128);
+}
+
+/**
+ * ms912x_line_to_rgb - bring one line of a framebuffer into packed RGB
+ * @dst:    output, 3 bytes per pixel in R, G, B order
+ * @src:    input in @format
+ * @width:  number of pixels
+ * @format: DRM fourcc, one that ms912x_format_cpp() accepts
+ */
+void ms912x_line_to_rgb(u8 *dst, const void *src, unsigned int width,
+			u32 format)
+{
+	const u8 *yuv = src;
+	unsigned int x;
+
+	switch (format) {
+	case DRM_FORMAT_XRGB8888:
+	case DRM_FORMAT_ARGB8888:
+		ms912x_xrgb8888_to_rgb_line(dst, src, width);
+		break;
+	case DRM_FORMAT_XBGR8888:
+		ms912x_xbgr8888_to_rgb_line(dst, src, width);
+		break;
+	case DRM_FORMAT_RGB565:
+		ms912x_rgb565_to_rgb_line(dst, src, width);
+		break;
+	case DRM_FORMAT_UYVY:
+		for (x = 0; x < width; x += 2, yuv += 4, dst += 6)
+			ms912x_yuv_pair_to_rgb(dst, yuv[1], yuv[3], yuv[0],
+					       yuv[2], x + 1 == width);
+		break;
+	case DRM_FORMAT_YUYV:
+		for (x = 0; x < width; x += 2, yuv += 4, dst += 6)
+			ms912x_yuv_pair_to_rgb(dst, yuv[0], yuv[2], yuv[1],
+					       yuv[3], x + 1 == width);
+		break;
+	}
+}
+
+static inline u8 ms912x_blend(int dst, int src, int alpha)
+{
+	return (dst * (255 - alpha) + src * alpha + 127) / 255;
+}
+
+/**
+ * ms912x_blend_argb_to_uyvy_line - draw ARGB8888 pixels over a UYVY line
+ * @dst:   UYVY pixels, starting at a pixel pair
+ * @src:   ARGB8888 input, not premultiplied
+ * @width: number of pixels, even
+ *
+ * The conversion is affine, so blending in YUV matches blending before it
+ * up to rounding.  The chroma of each pair is weighted by both alphas.
+ */
+void ms912x_blend_argb_to_uyvy_line(u8 *dst, const u32 *src,
+				    unsigned int width)
+{
+	int r0, g0, b0, a0, r1, g1, b1, a1;
+	unsigned int x;
+
+	for (x = 0; x < width; x += 2, dst += 4) {
+		a0 = src[x] >> 24;
+		a1 = src[x + 1] >> 24;
+		if (!a0 && !a1)
+			continue;
+
+		r0 = (src[x] >> 16) & 0xff;
+		g0 = (src[x] >> 8) & 0xff;
+		b0 = src[x] & 0xff;
+		r1 = (src[x + 1] >> 16) & 0xff;
+		g1 = (src[x + 1] >> 8) & 0xff;
+		b1 = src[x + 1] & 0xff;
+
+		dst[0] = (dst[0] * (510 - a0 - a1) +
+			  ms912x_rgb_to_u(r0, g0, b0) * a0 +
+			  ms912x_rgb_to_u(r1, g1, b1) * a1 + 255) / 510;
+		dst[1] = ms912x_blend(dst[1], ms912x_rgb_to_y(r0, g0, b0), a0);
+		dst[2] = (dst[2] * (510 - a0 - a1) +
+			  ms912x_rgb_to_v(r0, g0, b0) * a0 +
+			  ms912x_rgb_to_v(r1, g1, b1) * a1 + 255) / 510;
+		dst[3] = ms912x_blend(dst[3], ms912x_rgb_to_y(r1, g1, b1), a1);
+	}
+}
+
+/**
+ * ms912x_blend_argb_to_rgb_line - draw ARGB8888 pixels over an RGB line
+ * @dst:   packed R, G, B pixels
+ * @src:   ARGB8888 input, not premultiplied
+ * @width: number of pixels
+ */
+void ms912x_blend_argb_to_rgb_line(u8 *dst, const u32 *src,
+				   unsigned int width)
+{
+	unsigned int x;
+	int a;
+
+	for (x = 0; x < width; x++, dst += 3) {
+		a = src[x] >> 24;
+		if (!a)
+			continue;
+
+		dst[0] = ms912x_blend(dst[0], (src[x] >> 16) & 0xff, a);
+		dst[1] = ms912x_blend(dst[1], (src[x] >> 8) & 0xff, a);
+		dst[2] = ms912x_blend(dst[2], src[x] & 0xff, a);
+	}
+}
@@ -0,0 +1,45 @@
+#ifndef MS912X_CONVERT_H
+#define MS912X_CONVERT_H
+
+#include <linux/types.h>
+
+/*
+ * Colour conversion kernels.  Every implementation must produce output that
+ * is bit-identical to the scalar reference ms912x_xrgb8888_to_uyvy_line_c():
+ * BT.601 limited range, chroma from the truncated average of each pixel pair.
+ *
+ * The SIMD variants live in their own translation units, built with FPU
+ * flags, and must only run inside a kernel FPU section; callers go through
+ * ms912x_xrgb8888_to_uyvy_line(), which handles that.  They accept any width
+ * and finish the tail with the scalar code.
+ */
+typedef void (*ms912x_line_fn)(u8 *dst, const u32 *src, unsigned int width);
+
+void ms912x_xrgb8888_to_uyvy_line_c(u8 *dst, const u32 *src,
+				    unsigned int width);
+void ms912x_xrgb8888_to_uyvy_line_sse2(u8 *dst, const u32 *src,
+				       unsigned int width);
+void ms912x_xrgb8888_to_uyvy_line_avx2(u8 *dst, const u32 *src,
+				       unsigned int width);
+void ms912x_xrgb8888_to_uyvy_line_neon(u8 *dst, const u32 *src,
+				       unsigned int width);
+
+const char *ms912x_convert_init(void);
+const char *ms912x_convert_name(void);
+void ms912x_xrgb8888_to_uyvy_line(u8 *dst, const u32 *src,
+				  unsigned int width);
+
+/* Any supported framebuffer format, see ms912x_format_cpp() */
+unsigned int ms912x_format_cpp(u32 format);
+void ms912x_line_to_uyvy(u8 *dst, const void *src, unsigned int width,
+			 u32 format);
+void ms912x_line_to_rgb(u8 *dst, const void *src, unsigned int width,
+			u32 format);
+
+/* Cursor blending over already converted lines */
+void ms912x_blend_argb_to_uyvy_line(u8 *dst, const u32 *src,
+				    unsigned int width);
+void ms912x_blend_argb_to_rgb_line(u8 *dst, const u32 *src,
+				   unsigned int width);
+
+#endif // MS912X_CONVERT_H
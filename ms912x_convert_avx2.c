@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * AVX2 XRGB8888 to UYVY conversion, 16 pixels per iteration.  Same maths
+ * as the SSE2 variant; the 128 bit lane split of the pack instructions is
+ * undone by a single permute of the output.  Built with FPU flags, only
+ * call through ms912x_xrgb8888_to_uyvy_line().
+ */
+
+#include <immintrin.h>
+
+#include "ms912x_convert.h"
+
+void ms912x_xrgb8888_to_uyvy_line_avx2(u8 *dst, const u32 *src,
+				       unsigned int width)
+{
+	const __m256i mask = _mm256_set1_epi32(0xff);
+	const __m256i ones = _mm256_set1_epi16(1);
+	const __m256i half = _mm256_set1_epi16(128);
+	const __m256i y_off = _mm256_set1_epi16(16);
+	const __m256i y_r = _mm256_set1_epi16(66);
+	const __m256i y_g = _mm256_set1_epi16(129);
+	const __m256i y_b = _mm256_set1_epi16(25);
+	const __m256i c_r = _mm256_setr_epi16(-38, -38, -38, -38,
+					      112, 112, 112, 112,
+					      -38, -38, -38, -38,
+					      112, 112, 112, 112);
+	const __m256i c_g = _mm256_setr_epi16(-74, -74, -74, -74,
+					      -94, -94, -94, -94,
+					      -74, -74, -74, -74,
+					      -94, -94, -94, -94);
+	const __m256i c_b = _mm256_setr_epi16(112, 112, 112, 112,
+					      -18, -18, -18, -18,
+					      112, 112, 112, 112,
+					      -18, -18, -18, -18);
+	__m256i lo, hi, r, g, b, y, ar, ag, ab, uv;
+	unsigned int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		lo = _mm256_loadu_si256((const __m256i *)(src + x));
+		hi = _mm256_loadu_si256((const __m256i *)(src + x + 8));
+
+		/* Lane 0 holds pixels 0-3 and 8-11, lane 1 pixels 4-7, 12-15 */
+		r = _mm256_packs_epi32(
+			_mm256_and_si256(_mm256_srli_epi32(lo, 16), mask),
+			_mm256_and_si256(_mm256_srli_epi32(hi, 16), mask));
+		g = _mm256_packs_epi32(
+			_mm256_and_si256(_mm256_srli_epi32(lo, 8), mask),
+			_mm256_and_si256(_mm256_srli_epi32(hi, 8), mask));
+		b = _mm256_packs_epi32(_mm256_and_si256(lo, mask),
+				       _mm256_and_si256(hi, mask));
+
+		y = _mm256_add_epi16(_mm256_mullo_epi16(r, y_r),
+				     _mm256_mullo_epi16(g, y_g));
+		y = _mm256_add_epi16(y, _mm256_mullo_epi16(b, y_b));
+		y = _mm256_add_epi16(
+			_mm256_srli_epi16(_mm256_add_epi16(y, half), 8), y_off);
+
+		ar = _mm256_srli_epi32(_mm256_madd_epi16(r, ones), 1);
+		ag = _mm256_srli_epi32(_mm256_madd_epi16(g, ones), 1);
+		ab = _mm256_srli_epi32(_mm256_madd_epi16(b, ones), 1);
+		ar = _mm256_packs_epi32(ar, ar);
+		ag = _mm256_packs_epi32(ag, ag);
+		ab = _mm256_packs_epi32(ab, ab);
+
+		uv = _mm256_add_epi16(_mm256_mullo_epi16(ar, c_r),
+				      _mm256_mullo_epi16(ag, c_g));
+		uv = _mm256_add_epi16(uv, _mm256_mullo_epi16(ab, c_b));
+		uv = _mm256_add_epi16(
+			_mm256_srai_epi16(_mm256_add_epi16(uv, half), 8), half);
+
+		uv = _mm256_unpacklo_epi16(uv, _mm256_srli_si256(uv, 8));
+		lo = _mm256_unpacklo_epi16(uv, y);
+		hi = _mm256_unpackhi_epi16(uv, y);
+
+		_mm256_storeu_si256((__m256i *)(dst + x * 2),
+				    _mm256_permute4x64_epi64(
+					    _mm256_packus_epi16(lo, hi), 0xd8));
+	}
+
+	if (x < width)
+		ms912x_xrgb8888_to_uyvy_line_c(dst + x * 2, src + x, width - x);
+}
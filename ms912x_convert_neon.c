@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * NEON XRGB8888 to UYVY conversion, 16 pixels per iteration.  Built with
+ * FPU flags, only call through ms912x_xrgb8888_to_uyvy_line().
+ */
+
+#include <asm/neon-intrinsics.h>
+
+#include "ms912x_convert.h"
+
+static inline uint8x8_t ms912x_neon_luma(uint8x8_t r, uint8x8_t g,
+					 uint8x8_t b)
+{
+	uint16x8_t y;
+
+	y = vmull_u8(r, vdup_n_u8(66));
+	y = vmlal_u8(y, g, vdup_n_u8(129));
+	y = vmlal_u8(y, b, vdup_n_u8(25));
+	y = vaddq_u16(y, vdupq_n_u16(128));
+	return vadd_u8(vshrn_n_u16(y, 8), vdup_n_u8(16));
+}
+
+static inline uint8x8_t ms912x_neon_chroma(int16x8_t r, int16x8_t g,
+					   int16x8_t b, s16 cr, s16 cg, s16 cb)
+{
+	int16x8_t c;
+
+	c = vmulq_n_s16(r, cr);
+	c = vmlaq_n_s16(c, g, cg);
+	c = vmlaq_n_s16(c, b, cb);
+	c = vshrq_n_s16(vaddq_s16(c, vdupq_n_s16(128)), 8);
+	return vmovn_u16(vreinterpretq_u16_s16(vaddq_s16(c, vdupq_n_s16(128))));
+}
+
+void ms912x_xrgb8888_to_uyvy_line_neon(u8 *dst, const u32 *src,
+				       unsigned int width)
+{
+	uint8x16x4_t px;
+	uint8x8x2_t y;
+	uint8x8x4_t out;
+	int16x8_t ar, ag, ab;
+	unsigned int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		/* Little endian XRGB8888 is B, G, R, X in memory */
+		px = vld4q_u8((const u8 *)(src + x));
+
+		y = vuzp_u8(ms912x_neon_luma(vget_low_u8(px.val[2]),
+					     vget_low_u8(px.val[1]),
+					     vget_low_u8(px.val[0])),
+			    ms912x_neon_luma(vget_high_u8(px.val[2]),
+					     vget_high_u8(px.val[1]),
+					     vget_high_u8(px.val[0])));
+
+		ar = vreinterpretq_s16_u16(vshrq_n_u16(vpaddlq_u8(px.val[2]), 1));
+		ag = vreinterpretq_s16_u16(vshrq_n_u16(vpaddlq_u8(px.val[1]), 1));
+		ab = vreinterpretq_s16_u16(vshrq_n_u16(vpaddlq_u8(px.val[0]), 1));
+
+		out.val[0] = ms912x_neon_chroma(ar, ag, ab, -38, -74, 112);
+		out.val[1] = y.val[0];
+		out.val[2] = ms912x_neon_chroma(ar, ag, ab, 112, -94, -18);
+		out.val[3] = y.val[1];
+		vst4_u8(dst + x * 2, out);
+	}
+
+	if (x < width)
+		ms912x_xrgb8888_to_uyvy_line_c(dst + x * 2, src + x, width - x);
+}
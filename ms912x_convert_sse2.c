@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * SSE2 XRGB8888 to UYVY conversion, 8 pixels per iteration.  Built with FPU
+ * flags, only call through ms912x_xrgb8888_to_uyvy_line().
+ */
+
+#include <emmintrin.h>
+
+#include "ms912x_convert.h"
+
+void ms912x_xrgb8888_to_uyvy_line_sse2(u8 *dst, const u32 *src,
+				       unsigned int width)
+{
+	const __m128i mask = _mm_set1_epi32(0xff);
+	const __m128i ones = _mm_set1_epi16(1);
+	const __m128i half = _mm_set1_epi16(128);
+	const __m128i y_off = _mm_set1_epi16(16);
+	const __m128i y_r = _mm_set1_epi16(66);
+	const __m128i y_g = _mm_set1_epi16(129);
+	const __m128i y_b = _mm_set1_epi16(25);
+	/* U coefficients in the low four lanes, V in the high four */
+	const __m128i c_r = _mm_setr_epi16(-38, -38, -38, -38,
+					   112, 112, 112, 112);
+	const __m128i c_g = _mm_setr_epi16(-74, -74, -74, -74,
+					   -94, -94, -94, -94);
+	const __m128i c_b = _mm_setr_epi16(112, 112, 112, 112,
+					   -18, -18, -18, -18);
+	__m128i lo, hi, r, g, b, y, ar, ag, ab, uv;
+	unsigned int x;
+
+	for (x = 0; x + 8 <= width; x += 8) {
+		lo = _mm_loadu_si128((const __m128i *)(src + x));
+		hi = _mm_loadu_si128((const __m128i *)(src + x + 4));
+
+		r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 16), mask),
+				    _mm_and_si128(_mm_srli_epi32(hi, 16), mask));
+		g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8), mask),
+				    _mm_and_si128(_mm_srli_epi32(hi, 8), mask));
+		b = _mm_packs_epi32(_mm_and_si128(lo, mask),
+				    _mm_and_si128(hi, mask));
+
+		/* The luma sum stays below 2^16, so unsigned 16 bit is enough */
+		y = _mm_add_epi16(_mm_mullo_epi16(r, y_r),
+				  _mm_mullo_epi16(g, y_g));
+		y = _mm_add_epi16(y, _mm_mullo_epi16(b, y_b));
+		y = _mm_add_epi16(_mm_srli_epi16(_mm_add_epi16(y, half), 8),
+				  y_off);
+
+		/* Truncated pair averages, duplicated for the U and V halves */
+		ar = _mm_srli_epi32(_mm_madd_epi16(r, ones), 1);
+		ag = _mm_srli_epi32(_mm_madd_epi16(g, ones), 1);
+		ab = _mm_srli_epi32(_mm_madd_epi16(b, ones), 1);
+		ar = _mm_packs_epi32(ar, ar);
+		ag = _mm_packs_epi32(ag, ag);
+		ab = _mm_packs_epi32(ab, ab);
+
+		uv = _mm_add_epi16(_mm_mullo_epi16(ar, c_r),
+				   _mm_mullo_epi16(ag, c_g));
+		uv = _mm_add_epi16(uv, _mm_mullo_epi16(ab, c_b));
+		uv = _mm_add_epi16(_mm_srai_epi16(_mm_add_epi16(uv, half), 8),
+				   half);
+
+		/* U0 V0 U1 V1 ..., then U0 Y0 V0 Y1 ... */
+		uv = _mm_unpacklo_epi16(uv, _mm_srli_si128(uv, 8));
+		lo = _mm_unpacklo_epi16(uv, y);
+		hi = _mm_unpackhi_epi16(uv, y);
+
+		_mm_storeu_si128((__m128i *)(dst + x * 2),
+				 _mm_packus_epi16(lo, hi));
+	}
+
+	if (x < width)
+		ms912x_xrgb8888_to_uyvy_line_c(dst + x * 2, src + x, width - x);
+}
@@ -0,0 +1,175 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Cursor plane.  The adapter has no cursor of its own, so the image is kept
+ * by the driver and blended into every frame update that covers it, see
+ * ms912x_blend_cursor().  Moving the cursor needs no new primary frame: the
+ * commit takes the primary plane state as it is, and only the tiles under
+ * the cursor's old and new position are encoded again from its framebuffer.
+ */
+
+#include <linux/iosys-map.h>
+
+#include <drm/drm_atomic.h>
+#include <drm/drm_atomic_helper.h>
+#include <drm/drm_damage_helper.h>
+#include <drm/drm_fourcc.h>
+#include <drm/drm_gem_framebuffer_helper.h>
+#include <drm/drm_plane.h>
+#include <drm/drm_print.h>
+
+#include "ms912x.h"
+
+static const u32 ms912x_cursor_formats[] = {
+	DRM_FORMAT_ARGB8888,
+};
+
+static int ms912x_cursor_atomic_check(struct drm_plane *plane,
+				      struct drm_atomic_state *state)
+{
+	struct ms912x_device *ms912x = to_ms912x(plane->dev);
+	struct drm_plane *primary = &ms912x->display_pipe.plane;
+	struct drm_plane_state *old_state =
+		drm_atomic_get_old_plane_state(state, plane);
+	struct drm_plane_state *new_state =
+		drm_atomic_get_new_plane_state(state, plane);
+	struct drm_plane_state *primary_state;
+	struct drm_crtc_state *crtc_state = NULL;
+	int ret;
+
+	if (new_state->crtc)
+		crtc_state = drm_atomic_get_new_crtc_state(state,
+							   new_state->crtc);
+
+	ret = drm_atomic_helper_check_plane_state(new_state, crtc_state,
+						  DRM_PLANE_NO_SCALING,
+						  DRM_PLANE_NO_SCALING,
+						  true, true);
+	if (ret)
+		return ret;
+
+	/*
+	 * The cursor area is redrawn from the primary framebuffer, which
+	 * must not change under a commit that does not hold its plane.
+	 */
+	if ((new_state->crtc || old_state->crtc) &&
+	    !drm_atomic_get_new_plane_state(state, primary)) {
+		primary_state = drm_atomic_get_plane_state(state, primary);
+		if (IS_ERR(primary_state))
+			return PTR_ERR(primary_state);
+		to_ms912x_plane_state(primary_state)->cursor_only = true;
+	}
+
+	if (!new_state->fb)
+		return 0;
+
+	if (new_state->crtc_w > MS912X_CURSOR_SIZE ||
+	    new_state->crtc_h > MS912X_CURSOR_SIZE)
+		return -EINVAL;
+
+	return 0;
+}
+
+static void ms912x_cursor_atomic_update(struct drm_plane *plane,
+					struct drm_atomic_state *state)
+{
+	struct ms912x_device *ms912x = to_ms912x(plane->dev);
+	struct drm_plane_state *old_state =
+		drm_atomic_get_old_plane_state(state, plane);
+	struct drm_plane_state *new_state =
+		drm_atomic_get_new_plane_state(state, plane);
+	struct drm_plane *primary = &ms912x->display_pipe.plane;
+	struct drm_crtc *crtc = &ms912x->display_pipe.crtc;
+	struct drm_plane_state *primary_state =
+		drm_atomic_get_new_plane_state(state, primary);
+	struct drm_framebuffer *fb = new_state->fb;
+	struct iosys_map map[DRM_FORMAT_MAX_PLANES];
+	struct drm_pending_vblank_event *event = NULL;
+	const void *image = NULL;
+	struct drm_rect rect, damage;
+	bool mapped = false;
+
+	/* Unless the primary plane changed too, ms912x_pipe_update() skips */
+	if (!primary_state || to_ms912x_plane_state(primary_state)->cursor_only) {
+		spin_lock_irq(&ms912x->drm.event_lock);
+		event = crtc->state->event;
+		crtc->state->event = NULL;
+		spin_unlock_irq(&ms912x->drm.event_lock);
+	}
+
+	if (!crtc->state->active)
+		primary_state = NULL;
+
+	rect = DRM_RECT_INIT(new_state->crtc_x, new_state->crtc_y,
+			     new_state->crtc_w, new_state->crtc_h);
+
+	/*
+	 * Clients may draw into the framebuffer they show.  Without damage
+	 * clips on this plane any commit is damage, a move included, but the
+	 * image is small.
+	 */
+	if (fb && (fb != old_state->fb ||
+		   drm_atomic_helper_damage_merged(old_state, new_state,
+						   &damage))) {
+		if (drm_gem_fb_vmap(fb, map, NULL)) {
+			drm_err_once(plane->dev, "cursor vmap failed\n");
+		} else if (drm_gem_fb_begin_cpu_access(fb, DMA_FROM_DEVICE)) {
+			drm_gem_fb_vunmap(fb, map);
+		} else {
+			image = map[0].vaddr +
+				(new_state->src_y >> 16) * fb->pitches[0] +
+				(new_state->src_x >> 16) * sizeof(u32);
+			mapped = true;
+		}
+	}
+
+	ms912x_post_cursor(ms912x, primary_state, &rect, new_state->visible,
+			   image, fb ? fb->pitches[0] : 0, event);
+
+	if (mapped) {
+		drm_gem_fb_end_cpu_access(fb, DMA_FROM_DEVICE);
+		drm_gem_fb_vunmap(fb, map);
+	}
+}
+
+static const struct drm_plane_helper_funcs ms912x_cursor_helper_funcs = {
+	.atomic_check = ms912x_cursor_atomic_check,
+	.atomic_update = ms912x_cursor_atomic_update,
+};
+
+static const struct drm_plane_funcs ms912x_cursor_funcs = {
+	.update_plane = drm_atomic_helper_update_plane,
+	.disable_plane = drm_atomic_helper_disable_plane,
+	.destroy = drm_plane_cleanup,
+	.reset = drm_atomic_helper_plane_reset,
+	.atomic_duplicate_state = drm_atomic_helper_plane_duplicate_state,
+	.atomic_destroy_state = drm_atomic_helper_plane_destroy_state,
+};
+
+/**
+ * ms912x_cursor_init - register the cursor plane
+ * @ms912x: device handle, its display pipe already set up
+ */
+int ms912x_cursor_init(struct ms912x_device *ms912x)
+{
+	struct drm_crtc *crtc = &ms912x->display_pipe.crtc;
+	struct drm_plane *plane = &ms912x->cursor_plane;
+	int ret;
+
+	ret = drm_universal_plane_init(&ms912x->drm, plane,
+				       drm_crtc_mask(crtc),
+				       &ms912x_cursor_funcs,
+				       ms912x_cursor_formats,
+				       ARRAY_SIZE(ms912x_cursor_formats),
+				       NULL, DRM_PLANE_TYPE_CURSOR, NULL);
+	if (ret)
+		return ret;
+
+	drm_plane_helper_add(plane, &ms912x_cursor_helper_funcs);
+
+	/* The simple pipe only knows its primary plane */
+	crtc->cursor = plane;
+	ms912x->drm.mode_config.cursor_width = MS912X_CURSOR_SIZE;
+	ms912x->drm.mode_config.cursor_height = MS912X_CURSOR_SIZE;
+
+	return 0;
+}
@@ -18,7 +18,16 @@
 #include <drm/drm_simple_kms_helper.h>
 
 #include "ms912x.h"
-#include "ms912x_compat.h" // REPLACEMENT: compatibility helpers
+#include "ms912x_compat.h"
+#include "ms912x_convert.h"
+#include "ms912x_trace.h"
+
+static int pixel_format;
+module_param(pixel_format, int, 0644);
+MODULE_PARM_DESC(pixel_format, "Pixel format sent to USB 3 adapters: 0 = by link speed and mode (default), 1 = UYVY, 2 = RGB");
+
+/* Sustained bulk rate budgeted for RGB on a SuperSpeed link, bytes/s */
+#define MS912X_RGB_MAX_RATE (300 * 1000 * 1000)
 
 /* Forward declaration to satisfy enable() calling update() */
 static void ms912x_pipe_update(struct drm_simple_display_pipe *pipe,
@@ -27,16 +36,83 @@ static void ms912x_pipe_update(struct drm_simple_display_pipe *pipe,
 static int ms912x_usb_suspend(struct usb_interface *interface,
                               pm_message_t message)
 {
-	struct drm_device *dev = usb_get_intfdata(interface);
+	struct ms912x_device *ms912x = usb_get_intfdata(interface);
+	int ret;
+
+	/*
+	 * Autosuspend leaves the pipe alone, a commit wakes the device up
+	 * again.  Without a working interrupt endpoint hotplug and unplug
+	 * are only seen by polling, which a suspended device cannot answer.
+	 */
+	if (PMSG_IS_AUTO(message)) {
+		if (!usb_anchor_empty(&ms912x->submitted) ||
+		    !ms912x_int_active(ms912x))
+			return -EBUSY;
+
+		ms912x_poll_stop(ms912x);
+		return 0;
+	}
+
+	flush_work(&ms912x->init_work);
+
+	/* Leaves the device powered, see ms912x_pipe_disable() */
+	ms912x->suspending = true;
+	ret = drm_mode_config_helper_suspend(&ms912x->drm);
+	ms912x->suspending = false;
+	if (ret)
+		return ret;
+
+	ms912x_poll_stop(ms912x);
+	ms912x_stop_updates(ms912x);
+	return 0;
+}
 
-	return drm_mode_config_helper_suspend(dev);
+/* Back from autosuspend, the pipe is still enabled if hw_mode is set */
+static int ms912x_runtime_resume(struct ms912x_device *ms912x)
+{
+	const struct ms912x_mode *mode = &ms912x->hw_mode;
+
+	if (mode->width && (ms912x->reset_resume ||
+			    !ms912x_resolution_kept(ms912x, mode))) {
+		ms912x_power_on(ms912x);
+		if (ms912x_restore_resolution(ms912x, mode))
+			ms912x_set_resolution(ms912x, mode);
+		ms912x_invalidate_shadow(ms912x);
+	}
+	ms912x->reset_resume = false;
+
+	ms912x_poll_start(ms912x);
+	return 0;
 }
 
+/*
+ * The helpers replay a full enable.  ms912x_program_mode() skips setting
+ * the mode again if the device still has it, and the shadow then keeps
+ * the frame from being sent in full.
+ */
 static int ms912x_usb_resume(struct usb_interface *interface)
 {
-	struct drm_device *dev = usb_get_intfdata(interface);
+	struct ms912x_device *ms912x = usb_get_intfdata(interface);
+	int ret;
+
+	if (!ms912x->drm.mode_config.suspend_state)
+		return ms912x_runtime_resume(ms912x);
+
+	ms912x_poll_start(ms912x);
+
+	ms912x->resuming = true;
+	ret = drm_mode_config_helper_resume(&ms912x->drm);
+	ms912x->resuming = false;
+	ms912x->reset_resume = false;
+	return ret;
+}
+
+static int ms912x_usb_reset_resume(struct usb_interface *interface)
+{
+	struct ms912x_device *ms912x = usb_get_intfdata(interface);
 
-	return drm_mode_config_helper_resume(dev);
+	ms912x->reset_resume = true;
+	return ms912x_usb_resume(interface);
 }
 
 /*
@@ -68,13 +144,13 @@ static int ms912x_dumb_create(struct drm_file *file_priv, struct drm_device *dev
 {
         int ret;
 
-        pr_info("ms912x: dumb_create %ux%u bpp=%u\n",
+        drm_dbg(dev, "dumb_create %ux%u bpp=%u\n",
                 args->width, args->height, args->bpp);
         ret = drm_gem_shmem_dumb_create(file_priv, dev, args);
         if (ret)
-                pr_err("ms912x: dumb_create failed %d\n", ret);
+                drm_err(dev, "dumb_create failed %d\n", ret);
         else
-                pr_info("ms912x: dumb_create handle=%u pitch=%u size=%llu\n",
+                drm_dbg(dev, "dumb_create handle=%u pitch=%u size=%llu\n",
                         args->handle, args->pitch, args->size);
         return ret;
 }
@@ -91,6 +167,9 @@ static const struct drm_driver driver = {
         .dumb_create = ms912x_dumb_create,
 #endif
         .gem_prime_import = ms912x_driver_gem_prime_import,
+#if defined(CONFIG_DEBUG_FS)
+        .debugfs_init = ms912x_debugfs_init,
+#endif
 
         .name = DRIVER_NAME,
         .desc = DRIVER_DESC,
@@ -103,15 +182,12 @@ static const struct drm_driver driver = {
 static int ms912x_atomic_commit(struct drm_device *dev,
                                 struct drm_atomic_state *state, bool nonblock)
 {
+        struct ms912x_device *ms912x = to_ms912x(dev);
         int ret;
 
-        drm_dbg(dev, "atomic_commit\n");
+        trace_ms912x_commit_begin(ms912x, nonblock);
         ret = drm_atomic_helper_commit(dev, state, nonblock);
-        if (!ret) {
-                struct ms912x_device *ms912x = to_ms912x(dev);
-                pr_info("ms912x: commit tail done, dpms=%d\n",
-                        ms912x->connector.dpms);
-        }
+        trace_ms912x_commit_end(ms912x, ret);
         return ret;
 }
 
@@ -172,6 +248,65 @@ ms912x_get_mode(const struct drm_display_mode *mode)
         return NULL;
 }
 
+/*
+ * RGB needs no chroma subsampling or colour conversion, but half again the
+ * bandwidth of UYVY.  Only adapters with MS912X_HAS_RGB take it, and unless
+ * overridden only on a SuperSpeed link with room for full frames.
+ */
+static unsigned int ms912x_mode_pix_fmt(struct ms912x_device *ms912x,
+                                        const struct ms912x_mode *mode)
+{
+        struct usb_device *udev = interface_to_usbdev(ms912x->intf);
+        u64 rate;
+
+        if (!(ms912x->flags & MS912X_HAS_RGB))
+                return mode->pix_fmt;
+
+        switch (pixel_format) {
+        case 1:
+                return MS912X_PIXFMT_UYVY;
+        case 2:
+                return MS912X_PIXFMT_RGB;
+        }
+
+        if (udev->speed < USB_SPEED_SUPER)
+                return mode->pix_fmt;
+
+        rate = (u64)mode->width * mode->height * mode->hz * MS912X_RGB_BPP;
+        return rate <= MS912X_RGB_MAX_RATE ? MS912X_PIXFMT_RGB : mode->pix_fmt;
+}
+
+/*
+ * Sets @mode on the device.  On resume, a device that still has the mode
+ * is left alone and a device that lost it gets the mode in one burst.
+ * Returns true if the device kept its state, including what it shows.
+ */
+static bool ms912x_program_mode(struct ms912x_device *ms912x,
+                                const struct ms912x_mode *mode)
+{
+        bool again = ms912x->resuming &&
+                     !memcmp(&ms912x->hw_mode, mode, sizeof(*mode));
+        int ret = -EAGAIN;
+
+        if (again && !ms912x->reset_resume &&
+            ms912x_resolution_kept(ms912x, mode)) {
+                ms912x_stats_inc(&ms912x->stats,
+                                 MS912X_STAT_MODESETS_SKIPPED);
+                return true;
+        }
+
+        if (again)
+                ret = ms912x_restore_resolution(ms912x, mode);
+        if (ret)
+                ret = ms912x_set_resolution(ms912x, mode);
+
+        if (ret)
+                memset(&ms912x->hw_mode, 0, sizeof(ms912x->hw_mode));
+        else
+                ms912x->hw_mode = *mode;
+        return false;
+}
+
 static void ms912x_pipe_enable(struct drm_simple_display_pipe *pipe,
                                struct drm_crtc_state *crtc_state,
                                struct drm_plane_state *plane_state)
@@ -179,17 +314,39 @@ static void ms912x_pipe_enable(struct drm_simple_display_pipe *pipe,
         struct ms912x_device *ms912x = to_ms912x(pipe->crtc.dev);
         struct drm_display_mode *mode = &crtc_state->mode;
         const struct ms912x_mode *ms_mode;
+        struct ms912x_mode programmed;
+        bool kept = false;
+        int ret;
 
-        pr_info("ms912x: enable %dx%d@%d\n", mode->hdisplay, mode->vdisplay,
-                drm_mode_vrefresh(mode));
+        drm_dbg_kms(&ms912x->drm, "enable %dx%d@%d\n", mode->hdisplay,
+                    mode->vdisplay, drm_mode_vrefresh(mode));
 
-        ms912x_power_on(ms912x);
+        /* The warm-up resolution must not land after ours */
+        wait_for_completion(&ms912x->warmed_up);
+
+        /* The pipe is enabled regardless, only the device is left alone */
+        ret = usb_autopm_get_interface(ms912x->intf);
+        if (ret)
+                drm_err(&ms912x->drm, "cannot wake the device: %d\n", ret);
+        else
+                ms912x_power_on(ms912x);
 
         ms_mode = ms912x_get_mode(mode);
         if (ms_mode) {
-                pr_info("ms912x: set mode %dx%d@%d\n",
-                        ms_mode->width, ms_mode->height, ms_mode->hz);
-                ms912x_set_resolution(ms912x, ms_mode);
+                programmed = *ms_mode;
+                programmed.pix_fmt = ms912x_mode_pix_fmt(ms912x, ms_mode);
+                drm_dbg_kms(&ms912x->drm, "set mode %dx%d@%d %s\n",
+                            ms_mode->width, ms_mode->height, ms_mode->hz,
+                            programmed.pix_fmt == MS912X_PIXFMT_RGB ?
+                                    "RGB" : "UYVY");
+                if (!ret) {
+                        kept = ms912x_program_mode(ms912x, &programmed);
+                } else {
+                        /* Set in full by ms912x_runtime_resume() */
+                        ms912x->hw_mode = programmed;
+                        ms912x->reset_resume = true;
+                }
+                ms912x->pix_fmt = programmed.pix_fmt;
         } else {
                 drm_err(&ms912x->drm, "unsupported mode %dx%d@%d\n",
                         mode->hdisplay, mode->vdisplay,
@@ -198,16 +355,37 @@ static void ms912x_pipe_enable(struct drm_simple_display_pipe *pipe,
 
         ms912x->mode = *mode;
 
+        ms912x_vblank_set_rate(ms912x, ms_mode ? ms_mode->hz :
+                                                drm_mode_vrefresh(mode));
+        drm_crtc_vblank_on(&pipe->crtc);
+
+        if (!kept)
+                ms912x_invalidate_shadow(ms912x);
+
         if (plane_state && plane_state->fb)
                 ms912x_pipe_update(pipe, NULL);
+
+        if (!ret)
+                usb_autopm_put_interface(ms912x->intf);
 }
 
 static void ms912x_pipe_disable(struct drm_simple_display_pipe *pipe)
 {
         struct ms912x_device *ms912x = to_ms912x(pipe->crtc.dev);
 
-        pr_info("ms912x: disable\n");
+        drm_dbg_kms(&ms912x->drm, "disable\n");
+        /* Also lets go of the plane state a waiting frame holds */
+        ms912x_stop_updates(ms912x);
+        drm_crtc_vblank_off(&pipe->crtc);
+
+        /* Powering off could lose the state resume hopes to find */
+        if (ms912x->suspending || usb_autopm_get_interface(ms912x->intf))
+                return;
+
+        /* Nothing for a resume to find once the device is off */
         ms912x_power_off(ms912x);
+        memset(&ms912x->hw_mode, 0, sizeof(ms912x->hw_mode));
+        usb_autopm_put_interface(ms912x->intf);
 }
 
 static enum drm_mode_status
@@ -232,7 +410,7 @@ static int ms912x_pipe_check(struct drm_simple_display_pipe *pipe,
         drm_dbg(dev, "atomic_check\n");
 
         if (fb) {
-                if (fb->format->format != DRM_FORMAT_XRGB8888) {
+                if (!ms912x_format_cpp(fb->format->format)) {
                         drm_err(dev, "unsupported format %p4cc\n",
                                 &fb->format->format);
                         return -EINVAL;
@@ -250,64 +428,198 @@ static int ms912x_pipe_check(struct drm_simple_display_pipe *pipe,
         return 0;
 }
 
+/*
+ * Called from the atomic commit path.  Only collects the damage and posts
+ * the frame to the encode worker, see ms912x_update.c.
+ */
 static void ms912x_pipe_update(struct drm_simple_display_pipe *pipe,
                                struct drm_plane_state *old_state)
 {
         struct drm_plane_state *state = pipe->plane.state;
         struct drm_framebuffer *fb = state->fb;
-        struct ms912x_device *ms912x;
-       struct drm_rect rect;
-       struct iosys_map map;
-       size_t size;
-       struct drm_gem_object *obj;
-       int ret;
-       bool full;
-
-        if (!fb)
+        struct ms912x_device *ms912x = to_ms912x(pipe->crtc.dev);
+        struct drm_pending_vblank_event *event;
+        struct drm_atomic_helper_damage_iter iter;
+        struct drm_rect clips[MS912X_MAX_CLIPS];
+        struct drm_rect clip, bounds;
+        unsigned int i, num_clips = 0;
+        size_t clip_len, len = 0;
+
+        /* Only there for the cursor, which posts the frame and flips */
+        if (to_ms912x_plane_state(state)->cursor_only)
                 return;
 
-        ms912x = to_ms912x(fb->dev);
+        /* Completed by the worker once the frame is on the device */
+        spin_lock_irq(&ms912x->drm.event_lock);
+        event = pipe->crtc.state->event;
+        pipe->crtc.state->event = NULL;
+        spin_unlock_irq(&ms912x->drm.event_lock);
 
-       obj = drm_gem_fb_get_obj(fb, 0);
-       pr_info("ms912x: update pitch=%u format=%p4cc handle=%u\n",
-               fb->pitches[0], &fb->format->format, obj->handle);
+        if (!fb) {
+                ms912x_send_vblank_event(ms912x, event);
+                return;
+        }
 
-       ret = drm_gem_fb_vmap(fb, &map, 0);
-        if (ret) {
-                drm_err(fb->dev, "vmap failed: %d\n", ret);
+        bounds = DRM_RECT_INIT(0, 0, fb->width, fb->height);
+        trace_ms912x_damage_begin(ms912x, &bounds, 0);
+
+        if (old_state) {
+                drm_atomic_helper_damage_iter_init(&iter, old_state, state);
+                drm_atomic_for_each_plane_damage(&iter, &clip) {
+                        if (num_clips < MS912X_MAX_CLIPS) {
+                                clips[num_clips++] = clip;
+                                continue;
+                        }
+                        ms912x_rect_union(&clips[MS912X_MAX_CLIPS - 1], &clip);
+                }
+        } else {
+                clips[0] = DRM_RECT_INIT(0, 0, fb->width, fb->height);
+                num_clips = 1;
+        }
+
+        bounds = (struct drm_rect){ };
+        for (i = 0; i < num_clips; i++) {
+                clip_len = ms912x_encoded_size(&clips[i], ms912x->pix_fmt);
+                trace_ms912x_damage_clip(ms912x, &clips[i], clip_len);
+                len += clip_len;
+                if (i)
+                        ms912x_rect_union(&bounds, &clips[i]);
+                else
+                        bounds = clips[i];
+        }
+        trace_ms912x_damage_end(ms912x, &bounds, len);
+
+        if (!num_clips) {
+                ms912x_send_vblank_event(ms912x, event);
                 return;
         }
 
-        if (old_state)
-                full = !drm_atomic_helper_damage_merged(old_state, state, &rect);
-        else
-                full = true;
-        if (full)
-                pr_info("ms912x: sending full frame %ux%u\n",
-                        fb->width, fb->height);
-        else
-                pr_info("ms912x: damage (%d,%d)-(%d,%d)\n",
-                        rect.x1, rect.y1, rect.x2, rect.y2);
+        ms912x_post_frame(ms912x, to_ms912x_plane_state(state), clips,
+                          num_clips, event);
+}
 
-       size = fb->pitches[0] * fb->height;
-       ms912x_transfer_framebuffer(ms912x, map.vaddr, size);
+/*
+ * The framebuffer is mapped here rather than in begin_fb_access, which
+ * only covers the commit: the worker encodes after the commit is done.
+ * Imports the device can read as they are may not map at all, so those
+ * are only mapped by the worker if it has to encode them after all.
+ */
+static int ms912x_pipe_prepare_fb(struct drm_simple_display_pipe *pipe,
+                                  struct drm_plane_state *plane_state)
+{
+        struct ms912x_device *ms912x = to_ms912x(pipe->crtc.dev);
+        struct drm_framebuffer *fb = plane_state->fb;
+        int ret;
+
+        ret = drm_gem_plane_helper_prepare_fb(&pipe->plane, plane_state);
+        if (ret || !fb || ms912x_fb_zero_copy_sgt(ms912x, fb))
+                return ret;
+
+        return ms912x_plane_state_vmap(ms912x,
+                                       to_ms912x_plane_state(plane_state));
+}
 
-       drm_gem_fb_vunmap(fb, &map);
+static void ms912x_pipe_reset_plane(struct drm_simple_display_pipe *pipe)
+{
+        struct drm_plane *plane = &pipe->plane;
+        struct ms912x_plane_state *state;
+
+        if (plane->state) {
+                ms912x_plane_state_put(to_ms912x_plane_state(plane->state));
+                plane->state = NULL;
+        }
+
+        state = kzalloc(sizeof(*state), GFP_KERNEL);
+        if (!state)
+                return;
+
+        kref_init(&state->ref);
+        __drm_gem_reset_shadow_plane(plane, &state->base);
 }
+
+static struct drm_plane_state *
+ms912x_pipe_duplicate_plane_state(struct drm_simple_display_pipe *pipe)
+{
+        struct drm_plane *plane = &pipe->plane;
+        struct ms912x_plane_state *state;
+
+        if (WARN_ON(!plane->state))
+                return NULL;
+
+        /* Mapped again by ms912x_pipe_prepare_fb() */
+        state = kzalloc(sizeof(*state), GFP_KERNEL);
+        if (!state)
+                return NULL;
+
+        kref_init(&state->ref);
+        __drm_gem_duplicate_shadow_plane_state(plane, &state->base);
+        return &state->base.base;
+}
+
+/* Freed once the worker is done with it as well */
+static void ms912x_pipe_destroy_plane_state(struct drm_simple_display_pipe *pipe,
+                                            struct drm_plane_state *plane_state)
+{
+        ms912x_plane_state_put(to_ms912x_plane_state(plane_state));
+}
+
 static const struct drm_simple_display_pipe_funcs ms912x_pipe_funcs = {
-       .prepare_fb = NULL,
-       .cleanup_fb = NULL,
+       .prepare_fb = ms912x_pipe_prepare_fb,
+       .reset_plane = ms912x_pipe_reset_plane,
+       .duplicate_plane_state = ms912x_pipe_duplicate_plane_state,
+       .destroy_plane_state = ms912x_pipe_destroy_plane_state,
        .enable = ms912x_pipe_enable,
        .disable = ms912x_pipe_disable,
        .check = ms912x_pipe_check,
        .mode_valid = ms912x_pipe_mode_valid,
        .update = ms912x_pipe_update,
+       .enable_vblank = ms912x_enable_vblank,
+       .disable_vblank = ms912x_disable_vblank,
 };
 
+/* XRGB8888 first, it is what fbdev and most clients pick */
 static const uint32_t ms912x_pipe_formats[] = {
         DRM_FORMAT_XRGB8888,
+        DRM_FORMAT_ARGB8888,
+        DRM_FORMAT_XBGR8888,
+        DRM_FORMAT_RGB565,
+        DRM_FORMAT_UYVY,
+        DRM_FORMAT_YUYV,
 };
 
+/*
+ * Device warm-up and the first connector probe, done after the DRM device
+ * is registered so that probing never waits on round trips to the adapter
+ * and adapters on one hub come up in parallel.  Modesets wait for the
+ * warm-up only: the fbdev setup below may itself enable the pipe.
+ */
+static void ms912x_init_work(struct work_struct *work)
+{
+        struct ms912x_device *ms912x =
+                container_of(work, struct ms912x_device, init_work);
+        int idx;
+
+        if (!drm_dev_enter(&ms912x->drm, &idx)) {
+                complete_all(&ms912x->warmed_up);
+                return;
+        }
+
+        if (usb_autopm_get_interface(ms912x->intf)) {
+                complete_all(&ms912x->warmed_up);
+        } else {
+                /* This stops weird behavior in the device */
+                ms912x_set_resolution(ms912x, &ms912x_mode_list[0]);
+                complete_all(&ms912x->warmed_up);
+                ms912x_connector_prefetch(ms912x);
+                usb_autopm_put_interface(ms912x->intf);
+        }
+        drm_dev_exit(idx);
+
+        drm_kms_helper_hotplug_event(&ms912x->drm);
+        ms912x_fbdev_setup(&ms912x->drm);
+        ms912x_poll_start(ms912x);
+}
+
 static int ms912x_usb_probe(struct usb_interface *interface,
                             const struct usb_device_id *id)
 {
@@ -339,7 +651,17 @@ static int ms912x_usb_probe(struct usb_interface *interface,
                 return PTR_ERR(ms912x);
 
         ms912x->intf = interface;
+        ms912x->flags = id->driver_info;
         dev = &ms912x->drm;
+        ms912x_stats_init(&ms912x->stats);
+
+        ret = ms912x_init_requests(ms912x);
+        if (ret)
+                return ret;
+
+        ret = ms912x_update_init(ms912x);
+        if (ret)
+                goto err_put_device;
 
         ms912x->dmadev = usb_intf_get_dma_device(interface);
         if (!ms912x->dmadev)
@@ -355,13 +677,18 @@ static int ms912x_usb_probe(struct usb_interface *interface,
         dev->mode_config.max_height = 2048;
         dev->mode_config.funcs = &ms912x_mode_config_funcs;
 
-        /* This stops weird behavior in the device */
-        ms912x_set_resolution(ms912x, &ms912x_mode_list[0]);
+        /* Programmed by ms912x_init_work() */
+        ms912x->pix_fmt = ms912x_mode_list[0].pix_fmt;
+        INIT_WORK(&ms912x->init_work, ms912x_init_work);
+        init_completion(&ms912x->warmed_up);
 
         ret = ms912x_connector_init(ms912x);
         if (ret)
                 goto err_put_device;
 
+        /* Hotplug on the interrupt endpoint wakes an idle adapter */
+        interface->needs_remote_wakeup = !!ms912x->int_urb;
+
         ret = drm_simple_display_pipe_init(&ms912x->drm, &ms912x->display_pipe,
                                            &ms912x_pipe_funcs,
                                            ms912x_pipe_formats,
@@ -370,6 +697,17 @@ static int ms912x_usb_probe(struct usb_interface *interface,
         if (ret)
                 goto err_put_device;
 
+        /* Lets atomic clients send damage rather than the whole plane */
+        drm_plane_enable_fb_damage_clips(&ms912x->display_pipe.plane);
+
+        ret = ms912x_cursor_init(ms912x);
+        if (ret)
+                goto err_put_device;
+
+        ret = ms912x_vblank_init(ms912x);
+        if (ret)
+                goto err_put_device;
+
         drm_mode_config_reset(dev);
 
         usb_set_intfdata(interface, ms912x);
@@ -380,7 +718,7 @@ static int ms912x_usb_probe(struct usb_interface *interface,
         if (ret)
                 goto err_poll_fini;
 
-        ms912x_fbdev_setup(dev);
+        queue_work(system_long_wq, &ms912x->init_work);
 
         dev_info(&interface->dev, "ms912x device bound\n");
 
@@ -392,6 +730,8 @@ err_poll_fini:
 err_put_device:
         if (ms912x->dmadev)
                 put_device(ms912x->dmadev);
+        ms912x_update_fini(ms912x);
+        ms912x_free_requests(ms912x);
         return ret;
 }
 
@@ -410,9 +750,15 @@ static void ms912x_usb_disconnect(struct usb_interface *interface)
                  le16_to_cpu(udev->descriptor.idProduct));
         dev_dbg(&interface->dev, "ms912x usb disconnect\n");
 
+        cancel_work_sync(&ms912x->init_work);
+        complete_all(&ms912x->warmed_up);
+        ms912x_poll_stop(ms912x);
         drm_kms_helper_poll_fini(dev);
         drm_dev_unplug(dev);
         drm_atomic_helper_shutdown(dev);
+        ms912x_vblank_fini(ms912x);
+        ms912x_update_fini(ms912x);
+        ms912x_free_requests(ms912x);
         if (ms912x->dmadev) {
                 put_device(ms912x->dmadev);
                 ms912x->dmadev = NULL;
@@ -432,11 +778,13 @@ static const struct usb_device_id id_table[] = {
         { USB_DEVICE_INTERFACE_NUMBER(0x345f, 0x9132, 3),
           .bInterfaceClass = USB_CLASS_VENDOR_SPEC,
           .bInterfaceSubClass = 0x00,
-          .bInterfaceProtocol = 0x00 },
+          .bInterfaceProtocol = 0x00,
+          .driver_info = MS912X_HAS_RGB },
         { USB_DEVICE_INTERFACE_NUMBER(0x345f, 0x9133, 3),
           .bInterfaceClass = USB_CLASS_VENDOR_SPEC,
           .bInterfaceSubClass = 0x00,
-          .bInterfaceProtocol = 0x00 },
+          .bInterfaceProtocol = 0x00,
+          .driver_info = MS912X_HAS_RGB },
         { }
 };
 MODULE_DEVICE_TABLE(usb, id_table);
@@ -447,20 +795,37 @@ static struct usb_driver ms912x_driver = {
         .disconnect = ms912x_usb_disconnect,
         .suspend = ms912x_usb_suspend,
         .resume = ms912x_usb_resume,
+        .reset_resume = ms912x_usb_reset_resume,
+        .supports_autosuspend = 1,
         .id_table = id_table,
+        MS912X_USB_PROBE_TYPE(PROBE_PREFER_ASYNCHRONOUS),
 };
 
 static int __init ms912x_init(void)
 {
-        int ret = usb_register(&ms912x_driver);
-        if (!ret)
-                pr_info("ms912x module loaded\n");
-        return ret;
+        int ret;
+
+        /* Also shown in dri/<minor>/ms912x/stats */
+        pr_debug("ms912x: using %s colour conversion\n", ms912x_convert_init());
+
+        ret = ms912x_sched_init();
+        if (ret)
+                return ret;
+
+        ret = usb_register(&ms912x_driver);
+        if (ret) {
+                ms912x_sched_exit();
+                return ret;
+        }
+
+        pr_info("ms912x module loaded\n");
+        return 0;
 }
 
 static void __exit ms912x_exit(void)
 {
         usb_deregister(&ms912x_driver);
+        ms912x_sched_exit();
         pr_info("ms912x module unloaded\n");
 }
 
@@ -0,0 +1,340 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <linux/kernel.h>
+#include <linux/string.h>
+
+#include "ms912x_frame.h"
+#include "ms912x_convert.h"
+
+/* Fixed 8 byte sequence closing every frame update, see re_notes/README.md */
+static const u8 ms912x_end_of_buffer[MS912X_END_LENGTH] = {
+	0xff, 0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+/**
+ * ms912x_rect_union - grow a rectangle to also cover another one
+ * @dst: rectangle to grow
+ * @src: rectangle to include
+ */
+void ms912x_rect_union(struct drm_rect *dst, const struct drm_rect *src)
+{
+	dst->x1 = min(dst->x1, src->x1);
+	dst->y1 = min(dst->y1, src->y1);
+	dst->x2 = max(dst->x2, src->x2);
+	dst->y2 = max(dst->y2, src->y2);
+}
+
+/**
+ * ms912x_align_rect - clip a damage rectangle to the device granularity
+ * @rect:   rectangle to adjust in place
+ * @width:  framebuffer width
+ * @height: framebuffer height
+ *
+ * The device addresses columns in units of 16 pixels.  The right edge is
+ * rounded up, so for modes like 1366x768 it may extend past @width; the
+ * encoder pads those columns.
+ *
+ * Returns false if nothing visible is left.
+ */
+bool ms912x_align_rect(struct drm_rect *rect, unsigned int width,
+		       unsigned int height)
+{
+	rect->x1 = clamp_t(int, rect->x1, 0, width);
+	rect->x2 = clamp_t(int, rect->x2, 0, width);
+	rect->y1 = clamp_t(int, rect->y1, 0, height);
+	rect->y2 = clamp_t(int, rect->y2, 0, height);
+
+	if (rect->x1 >= rect->x2 || rect->y1 >= rect->y2)
+		return false;
+
+	rect->x1 = round_down(rect->x1, MS912X_TILE_WIDTH);
+	rect->x2 = round_up(rect->x2, MS912X_TILE_WIDTH);
+	return true;
+}
+
+/* Bytes on the wire of an update of @rect */
+static u64 ms912x_clip_cost(const struct drm_rect *rect, unsigned int bpp)
+{
+	return (u64)drm_rect_width(rect) * drm_rect_height(rect) * bpp +
+	       MS912X_UPDATE_OVERHEAD;
+}
+
+/**
+ * ms912x_merge_clips - reduce damage to few aligned rectangles
+ * @clips:     damage, replaced with the result
+ * @num_clips: number of entries in @clips
+ * @width:     framebuffer width
+ * @height:    framebuffer height
+ * @pix_fmt:   MS912X_PIXFMT_* the device is set to
+ *
+ * Every clip is aligned with ms912x_align_rect() and empty ones are
+ * dropped.  Two clips are then merged into their bounding box whenever
+ * that takes no more bytes on the wire than sending both, e.g. for the
+ * adjacent line spans of console output or overlapping window damage.
+ *
+ * Returns the number of clips left.
+ */
+unsigned int ms912x_merge_clips(struct drm_rect *clips, unsigned int num_clips,
+				unsigned int width, unsigned int height,
+				unsigned int pix_fmt)
+{
+	unsigned int bpp = ms912x_pixfmt_bpp(pix_fmt);
+	unsigned int i, j, n = 0;
+	struct drm_rect merged;
+	bool again;
+
+	for (i = 0; i < num_clips; i++) {
+		if (ms912x_align_rect(&clips[i], width, height))
+			clips[n++] = clips[i];
+	}
+
+	do {
+		again = false;
+		for (i = 0; i < n; i++) {
+			for (j = i + 1; j < n; j++) {
+				merged = clips[i];
+				ms912x_rect_union(&merged, &clips[j]);
+				if (ms912x_clip_cost(&merged, bpp) >
+				    ms912x_clip_cost(&clips[i], bpp) +
+				    ms912x_clip_cost(&clips[j], bpp))
+					continue;
+
+				clips[i] = merged;
+				clips[j--] = clips[--n];
+				again = true;
+			}
+		}
+	} while (again);
+
+	return n;
+}
+
+/**
+ * ms912x_encoded_size - bytes needed for one encoded frame update
+ * @rect:    aligned rectangle
+ * @pix_fmt: MS912X_PIXFMT_* the device is set to
+ */
+size_t ms912x_encoded_size(const struct drm_rect *rect, unsigned int pix_fmt)
+{
+	return sizeof(struct ms912x_frame_update_header) +
+	       (size_t)drm_rect_width(rect) * drm_rect_height(rect) *
+		       ms912x_pixfmt_bpp(pix_fmt) +
+	       sizeof(ms912x_end_of_buffer);
+}
+
+/**
+ * ms912x_chunk_lines - lines of a rectangle per transfer-sized update
+ * @rect:    aligned rectangle
+ * @pix_fmt: MS912X_PIXFMT_* the device is set to
+ * @max_len: largest transfer in bytes
+ *
+ * Returns how many lines of @rect fit in @max_len bytes as one complete
+ * frame update, at least one.
+ */
+unsigned int ms912x_chunk_lines(const struct drm_rect *rect,
+				unsigned int pix_fmt, size_t max_len)
+{
+	size_t line_len = (size_t)drm_rect_width(rect) *
+			  ms912x_pixfmt_bpp(pix_fmt);
+
+	if (max_len <= MS912X_UPDATE_OVERHEAD + line_len)
+		return 1;
+	return (max_len - MS912X_UPDATE_OVERHEAD) / line_len;
+}
+
+/**
+ * ms912x_pack_header - write the header of a frame update
+ * @dst:  output, sizeof(struct ms912x_frame_update_header) bytes
+ * @rect: aligned rectangle
+ */
+void ms912x_pack_header(u8 *dst, const struct drm_rect *rect)
+{
+	struct ms912x_frame_update_header header = {
+		.header = cpu_to_be16(0xff00),
+		.x = rect->x1 / MS912X_TILE_WIDTH,
+		.y = cpu_to_be16(rect->y1),
+		.width = drm_rect_width(rect) / MS912X_TILE_WIDTH,
+		.height = cpu_to_be16(drm_rect_height(rect)),
+	};
+
+	memcpy(dst, &header, sizeof(header));
+}
+
+/**
+ * ms912x_pack_end - write the sequence closing a frame update
+ * @dst: output, MS912X_END_LENGTH bytes
+ */
+void ms912x_pack_end(u8 *dst)
+{
+	memcpy(dst, ms912x_end_of_buffer, sizeof(ms912x_end_of_buffer));
+}
+
+/* Black in UYVY, used for columns past the right edge of the framebuffer */
+static void ms912x_pad_uyvy_line(u8 *dst, unsigned int width)
+{
+	unsigned int x;
+
+	for (x = 0; x < width; x += 2) {
+		*dst++ = 0x80;
+		*dst++ = 0x10;
+		*dst++ = 0x80;
+		*dst++ = 0x10;
+	}
+}
+
+/**
+ * ms912x_encode_lines - convert the pixels of a rectangle to device format
+ * @dst:      output, drm_rect_width(@rect) pixels per line, no padding
+ * @src:      framebuffer contents
+ * @pitch:    framebuffer pitch in bytes
+ * @fb_width: framebuffer width in pixels
+ * @format:   framebuffer format, see ms912x_format_cpp()
+ * @pix_fmt:  MS912X_PIXFMT_* the device is set to
+ * @rect:     rectangle aligned with ms912x_align_rect()
+ */
+void ms912x_encode_lines(u8 *dst, const void *src, unsigned int pitch,
+			 unsigned int fb_width, u32 format,
+			 unsigned int pix_fmt, const struct drm_rect *rect)
+{
+	unsigned int bpp = ms912x_pixfmt_bpp(pix_fmt);
+	unsigned int cpp = ms912x_format_cpp(format);
+	unsigned int width = drm_rect_width(rect);
+	unsigned int visible = min_t(unsigned int, width, fb_width - rect->x1);
+	unsigned int padded = round_up(visible, 2);
+	size_t line_len = (size_t)width * bpp;
+	const void *line;
+	int y;
+
+	for (y = rect->y1; y < rect->y2; y++) {
+		line = src + (size_t)y * pitch + rect->x1 * cpp;
+		if (pix_fmt == MS912X_PIXFMT_RGB) {
+			ms912x_line_to_rgb(dst, line, visible, format);
+			if (visible < width)
+				memset(dst + visible * bpp, 0,
+				       (width - visible) * bpp);
+		} else {
+			ms912x_line_to_uyvy(dst, line, visible, format);
+			if (padded < width)
+				ms912x_pad_uyvy_line(dst + padded * bpp,
+						     width - padded);
+		}
+		dst += line_len;
+	}
+}
+
+/**
+ * ms912x_encode_rect - build one complete frame update
+ * @dst:      output, at least ms912x_encoded_size(@rect) bytes
+ * @src:      framebuffer contents
+ * @pitch:    framebuffer pitch in bytes
+ * @fb_width: framebuffer width in pixels
+ * @format:   framebuffer format, see ms912x_format_cpp()
+ * @pix_fmt:  MS912X_PIXFMT_* the device is set to
+ * @rect:     rectangle aligned with ms912x_align_rect()
+ *
+ * Writes the update header, the payload and the terminating sequence.
+ *
+ * Returns the number of bytes written.
+ */
+size_t ms912x_encode_rect(u8 *dst, const void *src, unsigned int pitch,
+			  unsigned int fb_width, u32 format,
+			  unsigned int pix_fmt, const struct drm_rect *rect)
+{
+	size_t len = ms912x_encoded_size(rect, pix_fmt);
+
+	ms912x_pack_header(dst, rect);
+	ms912x_encode_lines(dst + sizeof(struct ms912x_frame_update_header),
+			    src, pitch, fb_width, format, pix_fmt, rect);
+	memcpy(dst + len - sizeof(ms912x_end_of_buffer), ms912x_end_of_buffer,
+	       sizeof(ms912x_end_of_buffer));
+
+	return len;
+}
+
+/**
+ * ms912x_pack_update - wrap already encoded lines into a frame update
+ * @dst:     output, at least ms912x_encoded_size(@rect) bytes
+ * @payload: encoded data of the top left pixel of @rect
+ * @pitch:   distance between lines in @payload, in bytes
+ * @pix_fmt: MS912X_PIXFMT_* of @payload
+ * @rect:    aligned rectangle
+ *
+ * Returns the number of bytes written.
+ */
+size_t ms912x_pack_update(u8 *dst, const u8 *payload, size_t pitch,
+			  unsigned int pix_fmt, const struct drm_rect *rect)
+{
+	size_t line_len = (size_t)drm_rect_width(rect) *
+			  ms912x_pixfmt_bpp(pix_fmt);
+	u8 *out = dst;
+	int y;
+
+	ms912x_pack_header(out, rect);
+	out += sizeof(struct ms912x_frame_update_header);
+
+	if (pitch == line_len) {
+		memcpy(out, payload, line_len * drm_rect_height(rect));
+		out += line_len * drm_rect_height(rect);
+	} else {
+		for (y = rect->y1; y < rect->y2; y++) {
+			memcpy(out, payload, line_len);
+			payload += pitch;
+			out += line_len;
+		}
+	}
+
+	memcpy(out, ms912x_end_of_buffer, sizeof(ms912x_end_of_buffer));
+	out += sizeof(ms912x_end_of_buffer);
+
+	return out - dst;
+}
+
+/**
+ * ms912x_blend_cursor - draw the cursor into encoded lines
+ * @dst:     output of ms912x_encode_lines() for @rect
+ * @pix_fmt: MS912X_PIXFMT_* of @dst
+ * @rect:    rectangle aligned with ms912x_align_rect()
+ * @cursor:  cursor to draw, nothing happens unless it is visible
+ *
+ * In UYVY whole pixel pairs are blended, the half of a pair outside the
+ * cursor counts as transparent.
+ */
+void ms912x_blend_cursor(u8 *dst, unsigned int pix_fmt,
+			 const struct drm_rect *rect,
+			 const struct ms912x_cursor *cursor)
+{
+	unsigned int bpp = ms912x_pixfmt_bpp(pix_fmt);
+	size_t pitch = (size_t)drm_rect_width(rect) * bpp;
+	struct drm_rect area = cursor->rect;
+	u32 line[MS912X_CURSOR_SIZE + 2];
+	const u32 *image;
+	int x, y, x1, x2;
+	u8 *out;
+
+	if (!cursor->visible || !drm_rect_intersect(&area, rect))
+		return;
+
+	x1 = area.x1;
+	x2 = area.x2;
+	if (pix_fmt == MS912X_PIXFMT_UYVY) {
+		/* @rect starts on a tile, so pairs are aligned to even x */
+		x1 = round_down(x1, 2);
+		x2 = round_up(x2, 2);
+	}
+
+	for (y = area.y1; y < area.y2; y++) {
+		image = cursor->image +
+			(y - cursor->rect.y1) * MS912X_CURSOR_SIZE -
+			cursor->rect.x1;
+		for (x = x1; x < x2; x++)
+			line[x - x1] = x >= area.x1 && x < area.x2 ? image[x] :
+								     0;
+
+		out = dst + (size_t)(y - rect->y1) * pitch +
+		      (size_t)(x1 - rect->x1) * bpp;
+		if (pix_fmt == MS912X_PIXFMT_RGB)
+			ms912x_blend_argb_to_rgb_line(out, line, x2 - x1);
+		else
+			ms912x_blend_argb_to_uyvy_line(out, line, x2 - x1);
+	}
+}
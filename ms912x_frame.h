@@ -0,0 +1,99 @@
+#ifndef MS912X_FRAME_H
+#define MS912X_FRAME_H
+
+#include <linux/types.h>
+
+#include <drm/drm_rect.h>
+
+/*
+ * Frame update encoding and the shadow of what the device shows.  Pure
+ * computation on memory buffers, kept free of USB and DRM device state so
+ * tools/bench can build it in userspace.
+ */
+
+struct ms912x_frame_update_header {
+	__be16 header; /* ff 00 */
+	u8 x; /* left in multiple of 16 */
+	__be16 y;
+	u8 width; /* width in multiples of 16 */
+	__be16 height;
+} __attribute__((packed));
+
+/* Every frame update is closed by a fixed sequence of this many bytes */
+#define MS912X_END_LENGTH 8
+#define MS912X_UPDATE_OVERHEAD                                                 \
+	(sizeof(struct ms912x_frame_update_header) + MS912X_END_LENGTH)
+
+/* Horizontal addressing granularity of frame updates, in pixels */
+#define MS912X_TILE_WIDTH 16
+
+/* Pixel formats of the resolution request and their bytes per pixel */
+#define MS912X_PIXFMT_UYVY 0x2200
+#define MS912X_PIXFMT_RGB 0x1100 /* packed R, G, B */
+#define MS912X_UYVY_BPP 2
+#define MS912X_RGB_BPP 3
+
+static inline unsigned int ms912x_pixfmt_bpp(unsigned int pix_fmt)
+{
+	return pix_fmt == MS912X_PIXFMT_RGB ? MS912X_RGB_BPP : MS912X_UYVY_BPP;
+}
+
+/* Largest cursor image, in pixels either way */
+#define MS912X_CURSOR_SIZE 64
+
+/* Cursor drawn into the frame updates, see ms912x_blend_cursor() */
+struct ms912x_cursor {
+	struct drm_rect rect; /* on the screen, may reach past its edges */
+	bool visible;
+	u32 image[MS912X_CURSOR_SIZE * MS912X_CURSOR_SIZE]; /* ARGB8888 */
+};
+
+enum ms912x_shadow_mode {
+	MS912X_SHADOW_OFF,
+	MS912X_SHADOW_FRAME,
+	MS912X_SHADOW_CHECKSUM,
+};
+
+/* What the device currently shows, see ms912x_shadow.c */
+struct ms912x_shadow {
+	enum ms912x_shadow_mode mode;
+	unsigned int width; /* pixels, multiple of MS912X_TILE_WIDTH */
+	unsigned int height;
+	unsigned int pix_fmt; /* MS912X_PIXFMT_* the device is set to */
+	bool valid;
+	u8 *frame; /* MS912X_SHADOW_FRAME: encoded lines without padding */
+	u32 *sums; /* MS912X_SHADOW_CHECKSUM: one per tile and line */
+};
+
+void ms912x_rect_union(struct drm_rect *dst, const struct drm_rect *src);
+bool ms912x_align_rect(struct drm_rect *rect, unsigned int width,
+		       unsigned int height);
+unsigned int ms912x_merge_clips(struct drm_rect *clips, unsigned int num_clips,
+				unsigned int width, unsigned int height,
+				unsigned int pix_fmt);
+size_t ms912x_encoded_size(const struct drm_rect *rect, unsigned int pix_fmt);
+unsigned int ms912x_chunk_lines(const struct drm_rect *rect,
+				unsigned int pix_fmt, size_t max_len);
+void ms912x_pack_header(u8 *dst, const struct drm_rect *rect);
+void ms912x_pack_end(u8 *dst);
+void ms912x_encode_lines(u8 *dst, const void *src, unsigned int pitch,
+			 unsigned int fb_width, u32 format,
+			 unsigned int pix_fmt, const struct drm_rect *rect);
+size_t ms912x_encode_rect(u8 *dst, const void *src, unsigned int pitch,
+			  unsigned int fb_width, u32 format,
+			  unsigned int pix_fmt, const struct drm_rect *rect);
+size_t ms912x_pack_update(u8 *dst, const u8 *payload, size_t pitch,
+			  unsigned int pix_fmt, const struct drm_rect *rect);
+void ms912x_blend_cursor(u8 *dst, unsigned int pix_fmt,
+			 const struct drm_rect *rect,
+			 const struct ms912x_cursor *cursor);
+
+void ms912x_shadow_prepare(struct ms912x_shadow *shadow, unsigned int width,
+			   unsigned int height, unsigned int pix_fmt);
+void ms912x_shadow_free(struct ms912x_shadow *shadow);
+size_t ms912x_shadow_max_packed(const struct ms912x_shadow *shadow,
+				const struct drm_rect *rect);
+size_t ms912x_shadow_pack(struct ms912x_shadow *shadow, u8 *dst,
+			  const u8 *payload, const struct drm_rect *rect);
+
+#endif // MS912X_FRAME_H
@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Update rate governor.  The bulk throughput the link sustains is measured
+ * from URB completions, counting only the time the bus had work queued.
+ * After each frame the worker holds off the next one until the backlog
+ * left on the bus is expected to be down to a single URB, and never runs
+ * faster than the refresh rate.  Commits arriving meanwhile merge their
+ * damage in the mailbox, so a slow link shows fewer, complete frames
+ * instead of falling further behind.
+ */
+
+#include <linux/jiffies.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+
+#include "ms912x.h"
+
+static bool governor = true;
+module_param(governor, bool, 0644);
+MODULE_PARM_DESC(governor, "Lower the update rate to what the link sustains (default: true)");
+
+/* Shortest busy time a throughput sample is taken from */
+#define MS912X_GOVERNOR_MIN_SAMPLE_NS (2 * NSEC_PER_MSEC)
+
+/**
+ * ms912x_governor_done - account a completed URB
+ * @gov:     governor state
+ * @request: the completed request
+ * @now:     completion time
+ *
+ * The bus was busy with @request from its submission or the previous
+ * completion, whichever is later.  Called with requests_lock held.
+ */
+void ms912x_governor_done(struct ms912x_governor *gov,
+			  struct ms912x_usb_request *request, ktime_t now)
+{
+	struct urb *urb = request->urb;
+	ktime_t start = ktime_after(gov->last_done, request->submitted_at) ?
+				gov->last_done : request->submitted_at;
+
+	gov->bytes_done += urb->transfer_buffer_length;
+	gov->last_done = now;
+	if (urb->status)
+		return;
+
+	gov->sample_bytes += urb->actual_length;
+	gov->sample_ns += ktime_to_ns(ktime_sub(now, start));
+}
+
+/**
+ * ms912x_governor_frame_sent - plan the next frame after one was queued
+ * @ms912x: device handle
+ * @start:  when the worker picked the frame up
+ */
+void ms912x_governor_frame_sent(struct ms912x_device *ms912x, ktime_t start)
+{
+	struct ms912x_governor *gov = &ms912x->governor;
+	u64 backlog, bytes, ns, drain_ns = 0;
+	ktime_t next;
+
+	spin_lock_irq(&ms912x->requests_lock);
+	backlog = gov->bytes_queued - gov->bytes_done;
+	bytes = gov->sample_bytes;
+	ns = gov->sample_ns;
+	if (ns >= MS912X_GOVERNOR_MIN_SAMPLE_NS) {
+		gov->sample_bytes = 0;
+		gov->sample_ns = 0;
+	}
+	spin_unlock_irq(&ms912x->requests_lock);
+
+	if (ns >= MS912X_GOVERNOR_MIN_SAMPLE_NS) {
+		bytes = div64_u64(bytes * NSEC_PER_SEC, ns);
+		gov->rate = gov->rate ? (3 * gov->rate + bytes) / 4 : bytes;
+	}
+
+	/* Keep one URB's worth queued so the bus does not idle meanwhile */
+	if (gov->rate && backlog > MS912X_MAX_TRANSFER_LENGTH)
+		drain_ns = div64_u64((backlog - MS912X_MAX_TRANSFER_LENGTH) *
+				     NSEC_PER_SEC, gov->rate);
+
+	next = ktime_add(start, ms912x->vblank_period);
+	if (ktime_after(ktime_add_ns(ktime_get(), drain_ns), next))
+		next = ktime_add_ns(ktime_get(), drain_ns);
+	gov->next_frame = next;
+
+	ms912x_stats_set(&ms912x->stats, MS912X_GAUGE_LINK_RATE, gov->rate);
+	ms912x_stats_set(&ms912x->stats, MS912X_GAUGE_BACKLOG_BYTES, backlog);
+	ms912x_stats_set(&ms912x->stats, MS912X_GAUGE_UPDATE_INTERVAL_US,
+			 ktime_us_delta(next, start));
+}
+
+/**
+ * ms912x_governor_delay - time the worker has to wait for the next frame
+ * @ms912x: device handle
+ *
+ * Returns 0 if a frame may be sent now, otherwise the delay in jiffies.
+ */
+unsigned long ms912x_governor_delay(struct ms912x_device *ms912x)
+{
+	s64 delta;
+
+	if (!governor)
+		return 0;
+
+	delta = ktime_us_delta(ms912x->governor.next_frame, ktime_get());
+	if (delta <= 0)
+		return 0;
+
+	return usecs_to_jiffies(delta);
+}
@@ -3,32 +3,99 @@
 #include <linux/slab.h> // FIX: kzalloc/kfree
 #include <linux/string.h> // FIX: memcpy/memset helpers
 
+#include <drm/drm_edid.h>
+
 #include "ms912x.h"
+#include "ms912x_trace.h"
 
-int ms912x_read_byte(struct ms912x_device *ms912x, u16 address)
+/*
+ * Issues one 0xb5 read report.  The reply carries the requested register in
+ * data[0] followed by the registers after it.  Returns the reply length.
+ */
+static int ms912x_read_report(struct ms912x_device *ms912x,
+			      struct ms912x_request *request, u16 address)
 {
+	struct usb_device *usb_dev = interface_to_usbdev(ms912x->intf);
 	int ret;
-	struct usb_interface *intf = ms912x->intf;
-	struct usb_device *usb_dev = interface_to_usbdev(intf);
-        struct ms912x_request *request = kzalloc(8, GFP_KERNEL); // FIX: allocate request
-        if (!request)
-                return -ENOMEM; // FIX: handle allocation failure
 
-        request->type = 0xb5;
+	if (address == MS912X_REG_STATUS)
+		ms912x_stats_inc(&ms912x->stats, MS912X_STAT_CTRL_READ_STATUS);
+	else if (address >= MS912X_REG_EDID_BASE &&
+		 address < MS912X_REG_EDID_BASE + 4 * EDID_LENGTH)
+		ms912x_stats_inc(&ms912x->stats, MS912X_STAT_CTRL_READ_EDID);
+	else
+		ms912x_stats_inc(&ms912x->stats, MS912X_STAT_CTRL_READ_OTHER);
+
+	memset(request, 0, sizeof(*request));
+	request->type = 0xb5;
 	request->addr = cpu_to_be16(address);
-	usb_control_msg(usb_dev, usb_sndctrlpipe(usb_dev, 0),
-			HID_REQ_SET_REPORT,
-			USB_DIR_OUT | USB_TYPE_CLASS | USB_RECIP_INTERFACE,
-			0x0300, 0, request, 8, USB_CTRL_SET_TIMEOUT);
+	ret = usb_control_msg(usb_dev, usb_sndctrlpipe(usb_dev, 0),
+			      HID_REQ_SET_REPORT,
+			      USB_DIR_OUT | USB_TYPE_CLASS | USB_RECIP_INTERFACE,
+			      0x0300, 0, request, sizeof(*request),
+			      USB_CTRL_SET_TIMEOUT);
+	if (ret < 0)
+		return ret;
+
 	ret = usb_control_msg(usb_dev, usb_rcvctrlpipe(usb_dev, 0),
 			      HID_REQ_GET_REPORT,
 			      USB_DIR_IN | USB_TYPE_CLASS | USB_RECIP_INTERFACE,
-			      0x0300, 0, request, 8, USB_CTRL_GET_TIMEOUT);
+			      0x0300, 0, request, sizeof(*request),
+			      USB_CTRL_GET_TIMEOUT);
+	if (ret == 0)
+		ret = -EIO;
+	return ret;
+}
+
+int ms912x_read_byte(struct ms912x_device *ms912x, u16 address)
+{
+	int ret;
+        struct ms912x_request *request = kzalloc(8, GFP_KERNEL); // FIX: allocate request
+        if (!request)
+                return -ENOMEM; // FIX: handle allocation failure
 
+	ret = ms912x_read_report(ms912x, request, address);
 	if (ret > 0)
 		ret = request->data[0];
-	else if (ret == 0)
-		ret = -EIO;
+	kfree(request);
+	return ret;
+}
+
+/**
+ * ms912x_read_bytes - read a range of consecutive registers
+ * @ms912x:  device handle
+ * @address: first register
+ * @buf:     output
+ * @len:     number of registers to read
+ * @burst:   use every byte of a full reply instead of only the first
+ *
+ * One request buffer is used for the whole range.  In burst mode a full
+ * reply yields up to sizeof(request->data) registers per round trip.
+ */
+int ms912x_read_bytes(struct ms912x_device *ms912x, u16 address, u8 *buf,
+		      size_t len, bool burst)
+{
+	struct ms912x_request *request;
+	size_t i = 0, n;
+	int ret = 0;
+
+	request = kzalloc(sizeof(*request), GFP_KERNEL);
+	if (!request)
+		return -ENOMEM;
+
+	while (i < len) {
+		ret = ms912x_read_report(ms912x, request, address + i);
+		if (ret < 0)
+			break;
+
+		n = 1;
+		if (burst && ret == sizeof(*request))
+			n = min(len - i, sizeof(request->data));
+		memcpy(buf + i, request->data, n);
+		i += n;
+		ret = 0;
+	}
+
 	kfree(request);
 	return ret;
 }
@@ -46,11 +113,13 @@ static inline int ms912x_write_6_bytes(struct ms912x_device *ms912x,
         request->type = 0xa6;
 	request->addr = address;
 	memcpy(request->data, data, 6);
+	atomic64_inc(&ms912x->stats.reg_writes[request->addr]);
 
 	ret = usb_control_msg(
 		usb_dev, usb_sndctrlpipe(usb_dev, 0), HID_REQ_SET_REPORT,
 		USB_DIR_OUT | USB_TYPE_CLASS | USB_RECIP_INTERFACE, 0x0300, 0,
 		request, 8, USB_CTRL_SET_TIMEOUT);
+	trace_ms912x_reg_write(ms912x, request->addr, request->data, ret);
 	kfree(request);
 	return ret;
 }
@@ -76,66 +145,180 @@ int ms912x_power_off(struct ms912x_device *ms912x)
 
 	return ret;
 }
-int ms912x_set_resolution(struct ms912x_device *ms912x,
-			  const struct ms912x_mode *mode)
+#define MS912X_RESOLUTION_WRITES 6
+
+/* The register writes that program @mode, in the order the device wants */
+static void ms912x_resolution_writes(const struct ms912x_mode *mode,
+				     struct ms912x_write_request *writes)
 {
-	int ret;
-	u8 data[6];
-	struct ms912x_resolution_request resolution_request;
-	struct ms912x_mode_request mode_request;
+	struct ms912x_resolution_request *resolution_request;
+	struct ms912x_mode_request *mode_request;
+	int i;
 
-	int width = mode->width;
-	int height = mode->height;
-	int pixel_format = mode->pix_fmt;
-	int mode_num = mode->mode;
+	memset(writes, 0, MS912X_RESOLUTION_WRITES * sizeof(*writes));
+	for (i = 0; i < MS912X_RESOLUTION_WRITES; i++)
+		writes[i].type = 0xa6;
 
 	/* ??? Unknown */
-	memset(data, 0, sizeof(data));
-	data[0] = 0;
-        ret = ms912x_write_6_bytes(ms912x, MS912X_REG_APPLY, data); // FIX: use register macro
-	if (ret < 0)
-		return ret;
-
-	ms912x_read_byte(ms912x, 0x30);
-	ms912x_read_byte(ms912x, 0x33);
-	ms912x_read_byte(ms912x, 0xc620);
+	writes[0].addr = MS912X_REG_APPLY;
+	writes[0].data[0] = 0;
 
 	/* ??? Unknown */
-	memset(data, 0, sizeof(data));
-	data[0] = 0x03;
-        ret = ms912x_write_6_bytes(ms912x, MS912X_REG_PREP, data); // FIX: use register macro
-	if (ret < 0)
-		return ret;
+	writes[1].addr = MS912X_REG_PREP;
+	writes[1].data[0] = 0x03;
 
 	/* Write resolution */
-	resolution_request.width = cpu_to_be16(width);
-	resolution_request.height = cpu_to_be16(height);
-	resolution_request.pixel_format = cpu_to_be16(pixel_format);
-        ret = ms912x_write_6_bytes(ms912x, MS912X_REG_SET1, &resolution_request); // FIX: use register macro
-	if (ret < 0)
-		return ret;
+	writes[2].addr = MS912X_REG_SET1;
+	resolution_request = (void *)writes[2].data;
+	resolution_request->width = cpu_to_be16(mode->width);
+	resolution_request->height = cpu_to_be16(mode->height);
+	resolution_request->pixel_format = cpu_to_be16(mode->pix_fmt);
 
 	/* Write mode */
-	mode_request.mode = cpu_to_be16(mode_num);
-	mode_request.width = cpu_to_be16(width);
-	mode_request.height = cpu_to_be16(height);
-        ret = ms912x_write_6_bytes(ms912x, MS912X_REG_SET2, &mode_request); // FIX: use register macro
-	if (ret < 0)
-		return ret;
+	writes[3].addr = MS912X_REG_SET2;
+	mode_request = (void *)writes[3].data;
+	mode_request->mode = cpu_to_be16(mode->mode);
+	mode_request->width = cpu_to_be16(mode->width);
+	mode_request->height = cpu_to_be16(mode->height);
 
 	/* ??? Unknown */
-	memset(data, 0, sizeof(data));
-	data[0] = 1;
-        ret = ms912x_write_6_bytes(ms912x, MS912X_REG_APPLY, data); // FIX: use register macro
-	if (ret < 0)
-		return ret;
+	writes[4].addr = MS912X_REG_APPLY;
+	writes[4].data[0] = 1;
 
 	/* ??? Unknown */
-	memset(data, 0, sizeof(data));
-	data[0] = 1;
-        ret = ms912x_write_6_bytes(ms912x, MS912X_REG_COMMIT, data); // FIX: use register macro
-	if (ret < 0)
-		return ret;
+	writes[5].addr = MS912X_REG_COMMIT;
+	writes[5].data[0] = 1;
+}
+
+int ms912x_set_resolution(struct ms912x_device *ms912x,
+			  const struct ms912x_mode *mode)
+{
+	struct ms912x_write_request writes[MS912X_RESOLUTION_WRITES];
+	int i, ret;
+
+	ms912x_resolution_writes(mode, writes);
+
+	for (i = 0; i < MS912X_RESOLUTION_WRITES; i++) {
+		ret = ms912x_write_6_bytes(ms912x, writes[i].addr,
+					   writes[i].data);
+		if (ret < 0)
+			return ret;
+
+		/* ??? Unknown, between the first two writes in the captures */
+		if (i == 0) {
+			ms912x_read_byte(ms912x, 0x30);
+			ms912x_read_byte(ms912x, 0x33);
+			ms912x_read_byte(ms912x, 0xc620);
+		}
+	}
 
 	return 0;
-}
\ No newline at end of file
+}
+
+/* One control write of a burst, setup packet and report */
+struct ms912x_burst_write {
+	struct usb_ctrlrequest setup;
+	struct ms912x_write_request request;
+};
+
+static void ms912x_burst_write_complete(struct urb *urb)
+{
+	/* Status is collected once the whole burst is done */
+}
+
+/**
+ * ms912x_restore_resolution - program a mode in one pipelined burst
+ * @ms912x: device handle
+ * @mode:   mode the device was set to before
+ *
+ * Queues the writes of ms912x_set_resolution() on the control endpoint all
+ * at once instead of waiting out a round trip for each, and leaves out its
+ * reads.  For restoring a mode the device already took, e.g. on resume.
+ *
+ * Returns 0 or a negative error code; the caller can fall back to
+ * ms912x_set_resolution().
+ */
+int ms912x_restore_resolution(struct ms912x_device *ms912x,
+			      const struct ms912x_mode *mode)
+{
+	struct usb_device *usb_dev = interface_to_usbdev(ms912x->intf);
+	struct urb *urbs[MS912X_RESOLUTION_WRITES] = {};
+	struct ms912x_write_request writes[MS912X_RESOLUTION_WRITES];
+	struct ms912x_burst_write *burst;
+	struct usb_anchor anchor;
+	int i, ret = 0;
+
+	burst = kcalloc(MS912X_RESOLUTION_WRITES, sizeof(*burst), GFP_KERNEL);
+	if (!burst)
+		return -ENOMEM;
+
+	init_usb_anchor(&anchor);
+	ms912x_resolution_writes(mode, writes);
+
+	for (i = 0; i < MS912X_RESOLUTION_WRITES && !ret; i++) {
+		urbs[i] = usb_alloc_urb(0, GFP_KERNEL);
+		if (!urbs[i]) {
+			ret = -ENOMEM;
+			break;
+		}
+
+		burst[i].setup.bRequestType =
+			USB_DIR_OUT | USB_TYPE_CLASS | USB_RECIP_INTERFACE;
+		burst[i].setup.bRequest = HID_REQ_SET_REPORT;
+		burst[i].setup.wValue = cpu_to_le16(0x0300);
+		burst[i].setup.wLength = cpu_to_le16(sizeof(writes[i]));
+		burst[i].request = writes[i];
+		usb_fill_control_urb(urbs[i], usb_dev,
+				     usb_sndctrlpipe(usb_dev, 0),
+				     (u8 *)&burst[i].setup, &burst[i].request,
+				     sizeof(burst[i].request),
+				     ms912x_burst_write_complete, NULL);
+		atomic64_inc(&ms912x->stats.reg_writes[writes[i].addr]);
+
+		usb_anchor_urb(urbs[i], &anchor);
+		ret = usb_submit_urb(urbs[i], GFP_KERNEL);
+		if (ret)
+			usb_unanchor_urb(urbs[i]);
+	}
+
+	if (!usb_wait_anchor_empty_timeout(&anchor, USB_CTRL_SET_TIMEOUT)) {
+		usb_kill_anchored_urbs(&anchor);
+		if (!ret)
+			ret = -ETIMEDOUT;
+	}
+
+	for (i = 0; i < MS912X_RESOLUTION_WRITES && urbs[i]; i++) {
+		trace_ms912x_reg_write(ms912x, writes[i].addr, writes[i].data,
+				       urbs[i]->status ?: urbs[i]->actual_length);
+		if (!ret)
+			ret = urbs[i]->status;
+		usb_free_urb(urbs[i]);
+	}
+
+	kfree(burst);
+	return ret;
+}
+
+/**
+ * ms912x_resolution_kept - check whether the device still has a mode set
+ * @ms912x: device handle
+ * @mode:   mode last programmed
+ *
+ * Compares the active area the device reports, little endian at
+ * MS912X_REG_HACTIVE and MS912X_REG_VACTIVE, against @mode.  Burst reads
+ * are used only while the EDID reads have not found them broken; a reply
+ * padded with zeroes never matches, so at worst the mode is set again.
+ */
+bool ms912x_resolution_kept(struct ms912x_device *ms912x,
+			    const struct ms912x_mode *mode)
+{
+	u8 buf[MS912X_REG_VACTIVE + 2 - MS912X_REG_HACTIVE];
+	const u8 *vactive = buf + MS912X_REG_VACTIVE - MS912X_REG_HACTIVE;
+
+	if (ms912x_read_bytes(ms912x, MS912X_REG_HACTIVE, buf, sizeof(buf),
+			      ms912x->edid_burst))
+		return false;
+
+	return (buf[0] | buf[1] << 8) == mode->width &&
+	       (vactive[0] | vactive[1] << 8) == mode->height;
+}
@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Module-wide update scheduler shared by all adapters.  Every device has a
+ * single update work item, so however busy its screen, a device holds at
+ * most one slot of the shared queue and the devices are served in turn.
+ * A device's worker runs on a CPU of the NUMA node of its host controller,
+ * and the devices are spread over that node's CPUs so adapters on one
+ * controller do not all convert on the same core.
+ *
+ * Adapters behind the same host controller share its bandwidth.  Each bus
+ * keeps the bytes all of its adapters have queued; a device whose own
+ * backlog is above its fair share of that waits for one of its URBs to
+ * complete before queuing more.
+ */
+
+#include <linux/cpumask.h>
+#include <linux/idr.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/topology.h>
+#include <linux/usb/hcd.h>
+
+#include "ms912x.h"
+
+static bool sched_affinity = true;
+module_param(sched_affinity, bool, 0644);
+MODULE_PARM_DESC(sched_affinity, "Run each adapter's worker near its host controller (default: true)");
+
+static struct workqueue_struct *ms912x_update_wq;
+static struct workqueue_struct *ms912x_stripe_wq;
+
+/* Protects ms912x_buses and the device count of each bus */
+static DEFINE_MUTEX(ms912x_sched_lock);
+static LIST_HEAD(ms912x_buses);
+static DEFINE_IDA(ms912x_sched_slots);
+
+/**
+ * ms912x_sched_init - create the workqueues shared by all devices
+ */
+int ms912x_sched_init(void)
+{
+	ms912x_update_wq = alloc_workqueue("ms912x", WQ_HIGHPRI, 0);
+	if (!ms912x_update_wq)
+		return -ENOMEM;
+
+	ms912x_stripe_wq = alloc_workqueue("ms912x-stripe",
+					   WQ_UNBOUND | WQ_HIGHPRI, 0);
+	if (!ms912x_stripe_wq) {
+		destroy_workqueue(ms912x_update_wq);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/**
+ * ms912x_sched_exit - destroy the shared workqueues
+ *
+ * Called after all devices are gone.
+ */
+void ms912x_sched_exit(void)
+{
+	destroy_workqueue(ms912x_stripe_wq);
+	destroy_workqueue(ms912x_update_wq);
+	ida_destroy(&ms912x_sched_slots);
+}
+
+/**
+ * ms912x_sched_attach - add a device to the scheduler
+ * @ms912x: device handle
+ */
+int ms912x_sched_attach(struct ms912x_device *ms912x)
+{
+	struct usb_bus *bus = interface_to_usbdev(ms912x->intf)->bus;
+	struct ms912x_bus_share *share;
+	int slot, node;
+
+	slot = ida_alloc(&ms912x_sched_slots, GFP_KERNEL);
+	if (slot < 0)
+		return slot;
+
+	mutex_lock(&ms912x_sched_lock);
+	list_for_each_entry(share, &ms912x_buses, node) {
+		if (share->bus == bus)
+			goto found;
+	}
+
+	share = kzalloc(sizeof(*share), GFP_KERNEL);
+	if (!share) {
+		mutex_unlock(&ms912x_sched_lock);
+		ida_free(&ms912x_sched_slots, slot);
+		return -ENOMEM;
+	}
+	share->bus = bus;
+	atomic64_set(&share->backlog, 0);
+	list_add(&share->node, &ms912x_buses);
+found:
+	WRITE_ONCE(share->devices, share->devices + 1);
+	mutex_unlock(&ms912x_sched_lock);
+
+	node = dev_to_node(bus->controller);
+	ms912x->bus_share = share;
+	ms912x->sched_slot = slot;
+	ms912x->sched_cpu = cpumask_local_spread(slot, node);
+
+	return 0;
+}
+
+/**
+ * ms912x_sched_detach - remove a device from the scheduler
+ * @ms912x: device handle, its update work must be idle
+ */
+void ms912x_sched_detach(struct ms912x_device *ms912x)
+{
+	struct ms912x_bus_share *share = ms912x->bus_share;
+
+	if (!share)
+		return;
+
+	mutex_lock(&ms912x_sched_lock);
+	WRITE_ONCE(share->devices, share->devices - 1);
+	if (!share->devices) {
+		list_del(&share->node);
+		kfree(share);
+	}
+	mutex_unlock(&ms912x_sched_lock);
+
+	ida_free(&ms912x_sched_slots, ms912x->sched_slot);
+	ms912x->bus_share = NULL;
+}
+
+/**
+ * ms912x_sched_queue - schedule the update worker of a device
+ * @ms912x: device handle
+ * @delay:  jiffies to wait, a pending earlier run is kept
+ */
+void ms912x_sched_queue(struct ms912x_device *ms912x, unsigned long delay)
+{
+	int cpu = ms912x->sched_cpu;
+
+	if (!READ_ONCE(sched_affinity) || !cpu_online(cpu))
+		cpu = WORK_CPU_UNBOUND;
+
+	queue_delayed_work_on(cpu, ms912x_update_wq, &ms912x->update_work,
+			      delay);
+}
+
+/**
+ * ms912x_sched_queue_stripe - run a conversion stripe on the shared pool
+ * @work: the stripe's work item
+ */
+void ms912x_sched_queue_stripe(struct work_struct *work)
+{
+	queue_work(ms912x_stripe_wq, work);
+}
+
+/**
+ * ms912x_sched_over_share - whether a device should let its neighbours go
+ * @ms912x: device handle
+ *
+ * True if the bus holds more than a URB per adapter and this device queued
+ * more than its share of it.  The worker is then queued again by the next
+ * completion of one of the device's URBs, see ms912x_request_complete().
+ */
+bool ms912x_sched_over_share(struct ms912x_device *ms912x)
+{
+	struct ms912x_bus_share *share = ms912x->bus_share;
+	unsigned int devices = READ_ONCE(share->devices);
+	s64 bus_backlog = atomic64_read(&share->backlog);
+	u64 backlog;
+
+	if (devices < 2 ||
+	    bus_backlog <= (s64)devices * MS912X_MAX_TRANSFER_LENGTH)
+		return false;
+
+	/* Under the lock, so a completion either counts or sees the flag */
+	spin_lock_irq(&ms912x->requests_lock);
+	backlog = ms912x->governor.bytes_queued - ms912x->governor.bytes_done;
+	ms912x->sched_waiting = backlog > div_u64(bus_backlog, devices);
+	spin_unlock_irq(&ms912x->requests_lock);
+
+	return ms912x->sched_waiting;
+}
@@ -0,0 +1,226 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copy of what the device currently shows, used to drop the parts of a
+ * damaged rectangle that did not actually change.  Rectangles are compared
+ * in tiles of MS912X_TILE_WIDTH pixels per line, either against a full copy
+ * of the last encoded frame or, to save memory, against a checksum per tile.
+ */
+
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/string.h>
+
+#include "ms912x_frame.h"
+
+static int shadow_mode = MS912X_SHADOW_FRAME;
+module_param_named(shadow, shadow_mode, int, 0444);
+MODULE_PARM_DESC(shadow, "Skip unchanged tiles: 0 = off, 1 = full frame copy (default), 2 = per tile checksums");
+
+static inline unsigned int ms912x_tile_bytes(const struct ms912x_shadow *shadow)
+{
+	return MS912X_TILE_WIDTH * ms912x_pixfmt_bpp(shadow->pix_fmt);
+}
+
+/**
+ * ms912x_shadow_prepare - size the shadow for a framebuffer
+ * @shadow:  shadow state
+ * @width:   framebuffer width in pixels
+ * @height:  framebuffer height in pixels
+ * @pix_fmt: MS912X_PIXFMT_* the device is set to
+ *
+ * Reallocates and invalidates the shadow when the dimensions or the pixel
+ * format change.  On allocation failure the shadow is turned off rather
+ * than failing updates.
+ */
+void ms912x_shadow_prepare(struct ms912x_shadow *shadow, unsigned int width,
+			   unsigned int height, unsigned int pix_fmt)
+{
+	unsigned int tiles;
+
+	width = round_up(width, MS912X_TILE_WIDTH);
+	if (shadow->width == width && shadow->height == height &&
+	    shadow->pix_fmt == pix_fmt && shadow->mode != MS912X_SHADOW_OFF)
+		return;
+
+	ms912x_shadow_free(shadow);
+	shadow->pix_fmt = pix_fmt;
+
+	tiles = width / MS912X_TILE_WIDTH;
+	switch (shadow_mode) {
+	case MS912X_SHADOW_FRAME:
+		shadow->frame = kvmalloc_array(height,
+					       width * ms912x_pixfmt_bpp(pix_fmt),
+					       GFP_KERNEL);
+		if (!shadow->frame)
+			return;
+		shadow->mode = MS912X_SHADOW_FRAME;
+		break;
+	case MS912X_SHADOW_CHECKSUM:
+		shadow->sums = kvmalloc_array(height * tiles, sizeof(u32),
+					      GFP_KERNEL);
+		if (!shadow->sums)
+			return;
+		shadow->mode = MS912X_SHADOW_CHECKSUM;
+		break;
+	default:
+		return;
+	}
+
+	shadow->width = width;
+	shadow->height = height;
+}
+
+/**
+ * ms912x_shadow_free - release the shadow
+ * @shadow: shadow state
+ */
+void ms912x_shadow_free(struct ms912x_shadow *shadow)
+{
+	kvfree(shadow->frame);
+	kvfree(shadow->sums);
+	memset(shadow, 0, sizeof(*shadow));
+}
+
+/* Tiles are a multiple of 8 bytes in every pixel format */
+static u32 ms912x_tile_hash(const u8 *tile, unsigned int len)
+{
+	u64 h = 0x9e3779b97f4a7c15ULL;
+	u64 v;
+	int i;
+
+	for (i = 0; i < len; i += sizeof(v)) {
+		memcpy(&v, tile + i, sizeof(v));
+		h ^= v;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 32;
+	}
+	return (u32)h;
+}
+
+/* Compares one tile against the shadow and records it if it changed */
+static bool ms912x_tile_changed(struct ms912x_shadow *shadow, const u8 *tile,
+				unsigned int tx, unsigned int y)
+{
+	unsigned int tiles = shadow->width / MS912X_TILE_WIDTH;
+	unsigned int tile_bytes = ms912x_tile_bytes(shadow);
+	u8 *old;
+	u32 sum;
+
+	if (shadow->mode == MS912X_SHADOW_FRAME) {
+		old = shadow->frame + ((size_t)y * tiles + tx) * tile_bytes;
+		if (shadow->valid && !memcmp(old, tile, tile_bytes))
+			return false;
+		memcpy(old, tile, tile_bytes);
+		return true;
+	}
+
+	sum = ms912x_tile_hash(tile, tile_bytes);
+	if (shadow->valid && shadow->sums[y * tiles + tx] == sum)
+		return false;
+	shadow->sums[y * tiles + tx] = sum;
+	return true;
+}
+
+/* Whole line unchanged?  Lets static content skip the per tile loop. */
+static bool ms912x_line_unchanged(struct ms912x_shadow *shadow, const u8 *line,
+				  const struct drm_rect *rect, unsigned int y)
+{
+	unsigned int bpp = ms912x_pixfmt_bpp(shadow->pix_fmt);
+	size_t offset;
+
+	if (!shadow->valid || shadow->mode != MS912X_SHADOW_FRAME)
+		return false;
+
+	offset = ((size_t)y * shadow->width + rect->x1) * bpp;
+	return !memcmp(shadow->frame + offset, line,
+		       drm_rect_width(rect) * bpp);
+}
+
+/**
+ * ms912x_shadow_max_packed - worst case output of ms912x_shadow_pack()
+ * @shadow: shadow state
+ * @rect:   aligned rectangle
+ *
+ * Every line may end up as its own update.
+ */
+size_t ms912x_shadow_max_packed(const struct ms912x_shadow *shadow,
+				const struct drm_rect *rect)
+{
+	return ms912x_encoded_size(rect, shadow->pix_fmt) +
+	       (size_t)(drm_rect_height(rect) - 1) * MS912X_UPDATE_OVERHEAD;
+}
+
+/**
+ * ms912x_shadow_pack - emit frame updates for the changed parts of a rect
+ * @shadow:  shadow state, updated with the new contents
+ * @dst:     output, at least ms912x_shadow_max_packed(@rect) bytes
+ * @payload: encoded lines of @rect, see ms912x_encode_lines()
+ * @rect:    aligned rectangle inside the shadow dimensions
+ *
+ * Consecutive changed lines are grouped into bands whose horizontal extent
+ * covers every changed tile of the band; an unchanged line closes a band.
+ *
+ * Returns the number of bytes written, 0 if nothing changed.
+ */
+size_t ms912x_shadow_pack(struct ms912x_shadow *shadow, u8 *dst,
+			  const u8 *payload, const struct drm_rect *rect)
+{
+	unsigned int tiles = drm_rect_width(rect) / MS912X_TILE_WIDTH;
+	unsigned int tx0 = rect->x1 / MS912X_TILE_WIDTH;
+	unsigned int bpp = ms912x_pixfmt_bpp(shadow->pix_fmt);
+	unsigned int tile_bytes = ms912x_tile_bytes(shadow);
+	size_t pitch = (size_t)drm_rect_width(rect) * bpp;
+	struct drm_rect band = { };
+	bool open = false;
+	size_t len = 0;
+	const u8 *line;
+	unsigned int t;
+	int first, last, y;
+
+	for (y = rect->y1; y < rect->y2; y++) {
+		line = payload + (y - rect->y1) * pitch;
+		first = -1;
+		last = -1;
+
+		if (!ms912x_line_unchanged(shadow, line, rect, y)) {
+			for (t = 0; t < tiles; t++) {
+				if (!ms912x_tile_changed(shadow,
+							 line + t * tile_bytes,
+							 tx0 + t, y))
+					continue;
+				if (first < 0)
+					first = t;
+				last = t;
+			}
+		}
+
+		if (first < 0) {
+			if (open)
+				len += ms912x_pack_update(dst + len,
+					payload + (band.y1 - rect->y1) * pitch +
+					(band.x1 - rect->x1) * bpp,
+					pitch, shadow->pix_fmt, &band);
+			open = false;
+			continue;
+		}
+
+		first = rect->x1 + first * MS912X_TILE_WIDTH;
+		last = rect->x1 + (last + 1) * MS912X_TILE_WIDTH;
+		if (!open) {
+			band = DRM_RECT_INIT(first, y, last - first, 1);
+			open = true;
+		} else {
+			band.x1 = min(band.x1, first);
+			band.x2 = max(band.x2, last);
+			band.y2 = y + 1;
+		}
+	}
+
+	if (open)
+		len += ms912x_pack_update(dst + len,
+			payload + (band.y1 - rect->y1) * pitch +
+			(band.x1 - rect->x1) * bpp,
+			pitch, shadow->pix_fmt, &band);
+
+	return len;
+}
@@ -0,0 +1,190 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Frame pipeline statistics, exposed per device in debugfs as
+ * dri/<minor>/ms912x/stats.  Writing anything to dri/<minor>/ms912x/reset
+ * clears them.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/seq_file.h>
+
+#include <drm/drm_file.h>
+#include <drm/drm_print.h>
+
+#include "ms912x.h"
+#include "ms912x_convert.h"
+
+static const char *const ms912x_counter_names[MS912X_STAT_COUNT] = {
+	[MS912X_STAT_FRAMES_COMMITTED] = "frames_committed",
+	[MS912X_STAT_FRAMES_SENT] = "frames_sent",
+	[MS912X_STAT_FRAMES_DROPPED] = "frames_dropped",
+	[MS912X_STAT_FRAMES_FAILED] = "frames_failed",
+	[MS912X_STAT_FRAMES_ZERO_COPY] = "frames_zero_copy",
+	[MS912X_STAT_FRAMES_DEFERRED] = "frames_deferred",
+	[MS912X_STAT_FB_VMAPS] = "fb_vmaps",
+	[MS912X_STAT_MODESETS_SKIPPED] = "modesets_skipped",
+	[MS912X_STAT_BULK_BYTES] = "bulk_bytes",
+	[MS912X_STAT_BULK_URBS] = "bulk_urbs",
+	[MS912X_STAT_BULK_ERRORS] = "bulk_errors",
+	[MS912X_STAT_BULK_TIMEOUTS] = "bulk_timeouts",
+	[MS912X_STAT_CTRL_READ_STATUS] = "ctrl_read_status",
+	[MS912X_STAT_CTRL_READ_EDID] = "ctrl_read_edid",
+	[MS912X_STAT_CTRL_READ_OTHER] = "ctrl_read_other",
+};
+
+static const char *const ms912x_gauge_names[MS912X_GAUGE_COUNT] = {
+	[MS912X_GAUGE_LINK_RATE] = "link_rate",
+	[MS912X_GAUGE_UPDATE_INTERVAL_US] = "update_interval_us",
+	[MS912X_GAUGE_BACKLOG_BYTES] = "backlog_bytes",
+};
+
+static const char *const ms912x_hist_names[MS912X_HIST_COUNT] = {
+	[MS912X_HIST_FRAME_BYTES] = "frame_bytes",
+	[MS912X_HIST_DAMAGE_AREA] = "damage_pixels",
+	[MS912X_HIST_CONVERT_US] = "convert_us",
+	[MS912X_HIST_URB_LATENCY_US] = "urb_latency_us",
+};
+
+/**
+ * ms912x_stats_init - set up the statistics of a device
+ * @stats: statistics to initialise
+ */
+void ms912x_stats_init(struct ms912x_stats *stats)
+{
+	spin_lock_init(&stats->lock);
+	ms912x_stats_reset(stats);
+}
+
+/**
+ * ms912x_stats_reset - clear all counters and histograms
+ * @stats: statistics to clear
+ */
+void ms912x_stats_reset(struct ms912x_stats *stats)
+{
+	unsigned long flags;
+	int i;
+
+	for (i = 0; i < MS912X_STAT_COUNT; i++)
+		atomic64_set(&stats->counters[i], 0);
+	for (i = 0; i < ARRAY_SIZE(stats->reg_writes); i++)
+		atomic64_set(&stats->reg_writes[i], 0);
+
+	spin_lock_irqsave(&stats->lock, flags);
+	memset(stats->hist, 0, sizeof(stats->hist));
+	spin_unlock_irqrestore(&stats->lock, flags);
+}
+
+/**
+ * ms912x_stats_hist - record a sample in a log2 histogram
+ * @stats: device statistics
+ * @hist:  histogram to update
+ * @value: sample
+ *
+ * Safe to call from URB completion handlers.
+ */
+void ms912x_stats_hist(struct ms912x_stats *stats, enum ms912x_hist hist,
+		       u64 value)
+{
+	struct ms912x_histogram *h = &stats->hist[hist];
+	unsigned int bucket = min_t(unsigned int, fls64(value),
+				    MS912X_HIST_BUCKETS - 1);
+	unsigned long flags;
+
+	spin_lock_irqsave(&stats->lock, flags);
+	h->buckets[bucket]++;
+	h->count++;
+	h->sum += value;
+	h->max = max(h->max, value);
+	spin_unlock_irqrestore(&stats->lock, flags);
+}
+
+#if defined(CONFIG_DEBUG_FS)
+
+static void ms912x_stats_show_hist(struct seq_file *m,
+				   const struct ms912x_histogram *h,
+				   const char *name)
+{
+	int i;
+
+	seq_printf(m, "%s: count=%llu avg=%llu max=%llu\n", name, h->count,
+		   h->count ? div64_u64(h->sum, h->count) : 0, h->max);
+	for (i = 0; i < MS912X_HIST_BUCKETS; i++) {
+		if (!h->buckets[i])
+			continue;
+		/* Bucket i holds values of i significant bits */
+		seq_printf(m, "  < %-12llu %llu\n",
+			   i < 63 ? 1ULL << i : U64_MAX, h->buckets[i]);
+	}
+}
+
+static int ms912x_stats_show(struct seq_file *m, void *unused)
+{
+	struct ms912x_device *ms912x = m->private;
+	struct ms912x_stats *stats = &ms912x->stats;
+	struct ms912x_histogram hist[MS912X_HIST_COUNT];
+	unsigned long flags;
+	u64 count;
+	int i;
+
+	seq_printf(m, "convert: %s\n", ms912x_convert_name());
+
+	for (i = 0; i < MS912X_STAT_COUNT; i++)
+		seq_printf(m, "%s: %lld\n", ms912x_counter_names[i],
+			   atomic64_read(&stats->counters[i]));
+
+	for (i = 0; i < MS912X_GAUGE_COUNT; i++)
+		seq_printf(m, "%s: %lld\n", ms912x_gauge_names[i],
+			   atomic64_read(&stats->gauges[i]));
+
+	for (i = 0; i < ARRAY_SIZE(stats->reg_writes); i++) {
+		count = atomic64_read(&stats->reg_writes[i]);
+		if (count)
+			seq_printf(m, "ctrl_write_%02x: %llu\n", i, count);
+	}
+
+	spin_lock_irqsave(&stats->lock, flags);
+	memcpy(hist, stats->hist, sizeof(hist));
+	spin_unlock_irqrestore(&stats->lock, flags);
+
+	for (i = 0; i < MS912X_HIST_COUNT; i++)
+		ms912x_stats_show_hist(m, &hist[i], ms912x_hist_names[i]);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ms912x_stats);
+
+static ssize_t ms912x_stats_reset_write(struct file *file,
+					const char __user *buf, size_t len,
+					loff_t *ppos)
+{
+	struct ms912x_device *ms912x = file->private_data;
+
+	ms912x_stats_reset(&ms912x->stats);
+	return len;
+}
+
+static const struct file_operations ms912x_stats_reset_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.write = ms912x_stats_reset_write,
+	.llseek = noop_llseek,
+};
+
+/**
+ * ms912x_debugfs_init - create the per-device debugfs directory
+ * @minor: DRM minor being registered
+ */
+void ms912x_debugfs_init(struct drm_minor *minor)
+{
+	struct ms912x_device *ms912x = to_ms912x(minor->dev);
+	struct dentry *dir;
+
+	dir = debugfs_create_dir(DRIVER_NAME, minor->debugfs_root);
+	debugfs_create_file("stats", 0444, dir, ms912x, &ms912x_stats_fops);
+	debugfs_create_file("reset", 0200, dir, ms912x,
+			    &ms912x_stats_reset_fops);
+}
+
+#endif /* CONFIG_DEBUG_FS */
@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Parallel conversion of large updates.  The rectangle is cut into
+ * horizontal stripes that are converted concurrently on the unbound pool
+ * shared by all devices, each straight into its own output: a slice of the
+ * encode buffer or a URB buffer, see ms912x_fb_send_rect().  The update
+ * worker converts the first stripe itself and waits for the others.
+ */
+
+#include <linux/cpumask.h>
+#include <linux/module.h>
+
+#include "ms912x.h"
+
+static unsigned int stripes = 4;
+module_param(stripes, uint, 0644);
+MODULE_PARM_DESC(stripes, "Convert large updates in up to this many stripes in parallel, 1 = off (default: 4)");
+
+static unsigned int stripe_min_pixels = 256 * 1024;
+module_param(stripe_min_pixels, uint, 0644);
+MODULE_PARM_DESC(stripe_min_pixels, "Smallest update converted in stripes, in pixels (default: 262144)");
+
+static void ms912x_stripe_work(struct work_struct *work)
+{
+	struct ms912x_stripe *stripe =
+		container_of(work, struct ms912x_stripe, work);
+
+	ms912x_encode_lines(stripe->dst, stripe->src, stripe->pitch,
+			    stripe->fb_width, stripe->format, stripe->pix_fmt,
+			    &stripe->rect);
+	complete(&stripe->done);
+}
+
+/**
+ * ms912x_stripes_init - set up the stripe workers
+ * @ms912x: device handle
+ */
+void ms912x_stripes_init(struct ms912x_device *ms912x)
+{
+	int i;
+
+	for (i = 0; i < MS912X_MAX_STRIPES; i++) {
+		INIT_WORK(&ms912x->stripes[i].work, ms912x_stripe_work);
+		init_completion(&ms912x->stripes[i].done);
+	}
+}
+
+/**
+ * ms912x_stripes_count - how many stripes to convert a rectangle in
+ * @ms912x: device handle
+ * @rect:   rectangle about to be converted
+ *
+ * Returns 1 for updates below stripe_min_pixels, which stay on the calling
+ * CPU.
+ */
+unsigned int ms912x_stripes_count(struct ms912x_device *ms912x,
+				  const struct drm_rect *rect)
+{
+	unsigned int height = drm_rect_height(rect);
+	unsigned int n;
+
+	if ((u64)drm_rect_width(rect) * height < READ_ONCE(stripe_min_pixels))
+		return 1;
+
+	n = min3(READ_ONCE(stripes), num_online_cpus(), height);
+	return clamp_t(unsigned int, n, 1, MS912X_MAX_STRIPES);
+}
+
+/**
+ * ms912x_stripe_set - describe one stripe for ms912x_stripes_run()
+ * @ms912x:  device handle
+ * @i:       stripe index, below MS912X_MAX_STRIPES
+ * @dst:     output, see ms912x_encode_lines()
+ * @src:     framebuffer contents
+ * @fb:      framebuffer @src belongs to
+ * @pix_fmt: MS912X_PIXFMT_* the device is set to
+ * @rect:    lines of the stripe, aligned with ms912x_align_rect()
+ */
+void ms912x_stripe_set(struct ms912x_device *ms912x, unsigned int i, u8 *dst,
+		       const void *src, struct drm_framebuffer *fb,
+		       unsigned int pix_fmt, const struct drm_rect *rect)
+{
+	struct ms912x_stripe *stripe = &ms912x->stripes[i];
+
+	stripe->dst = dst;
+	stripe->src = src;
+	stripe->pitch = fb->pitches[0];
+	stripe->fb_width = fb->width;
+	stripe->format = fb->format->format;
+	stripe->pix_fmt = pix_fmt;
+	stripe->rect = *rect;
+}
+
+/**
+ * ms912x_stripes_run - convert the first @n stripes concurrently
+ * @ms912x: device handle
+ * @n:      number of stripes set up with ms912x_stripe_set()
+ *
+ * The caller converts the first stripe itself and returns once all are
+ * done.  Must be called from the update worker, which owns the stripes.
+ */
+void ms912x_stripes_run(struct ms912x_device *ms912x, unsigned int n)
+{
+	struct ms912x_stripe *stripe;
+	unsigned int i;
+
+	for (i = 1; i < n; i++) {
+		reinit_completion(&ms912x->stripes[i].done);
+		ms912x_sched_queue_stripe(&ms912x->stripes[i].work);
+	}
+
+	stripe = &ms912x->stripes[0];
+	ms912x_encode_lines(stripe->dst, stripe->src, stripe->pitch,
+			    stripe->fb_width, stripe->format, stripe->pix_fmt,
+			    &stripe->rect);
+
+	for (i = 1; i < n; i++)
+		wait_for_completion(&ms912x->stripes[i].done);
+}
+
+/**
+ * ms912x_encode_stripes - ms912x_encode_lines() spread over several CPUs
+ * @ms912x:  device handle
+ * @dst:     output, see ms912x_encode_lines()
+ * @src:     framebuffer contents
+ * @fb:      framebuffer @src belongs to
+ * @pix_fmt: MS912X_PIXFMT_* the device is set to
+ * @rect:    rectangle aligned with ms912x_align_rect()
+ * @n:       number of stripes, see ms912x_stripes_count()
+ */
+void ms912x_encode_stripes(struct ms912x_device *ms912x, u8 *dst,
+			   const void *src, struct drm_framebuffer *fb,
+			   unsigned int pix_fmt, const struct drm_rect *rect,
+			   unsigned int n)
+{
+	size_t line_len = (size_t)drm_rect_width(rect) *
+			  ms912x_pixfmt_bpp(pix_fmt);
+	unsigned int rows, i;
+	struct drm_rect stripe;
+	int y;
+
+	rows = DIV_ROUND_UP(drm_rect_height(rect), n);
+	for (i = 0, y = rect->y1; y < rect->y2; i++, y += rows) {
+		stripe = *rect;
+		stripe.y1 = y;
+		stripe.y2 = min(y + (int)rows, rect->y2);
+		ms912x_stripe_set(ms912x, i,
+				  dst + (size_t)(y - rect->y1) * line_len, src,
+				  fb, pix_fmt, &stripe);
+	}
+
+	ms912x_stripes_run(ms912x, i);
+}
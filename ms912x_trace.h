@@ -0,0 +1,224 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Tracepoints of the display update path.  Every event carries the DRM
+ * minor of the device, so traces of several adapters can be told apart:
+ *
+ *   trace-cmd record -e ms912x -e xhci-hcd ...
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM ms912x
+
+#if !defined(MS912X_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define MS912X_TRACE_H
+
+#include <linux/tracepoint.h>
+
+#include "ms912x.h"
+
+#define MS912X_TRACE_MINOR(ms912x) ((ms912x)->drm.primary->index)
+
+DECLARE_EVENT_CLASS(ms912x_status_class,
+	TP_PROTO(struct ms912x_device *ms912x, int status),
+	TP_ARGS(ms912x, status),
+	TP_STRUCT__entry(
+		__field(int, minor)
+		__field(int, status)
+	),
+	TP_fast_assign(
+		__entry->minor = MS912X_TRACE_MINOR(ms912x);
+		__entry->status = status;
+	),
+	TP_printk("minor=%d status=%d", __entry->minor, __entry->status)
+);
+
+DEFINE_EVENT(ms912x_status_class, ms912x_commit_begin,
+	TP_PROTO(struct ms912x_device *ms912x, int nonblock),
+	TP_ARGS(ms912x, nonblock)
+);
+
+DEFINE_EVENT(ms912x_status_class, ms912x_commit_end,
+	TP_PROTO(struct ms912x_device *ms912x, int ret),
+	TP_ARGS(ms912x, ret)
+);
+
+DECLARE_EVENT_CLASS(ms912x_fb_class,
+	TP_PROTO(struct ms912x_device *ms912x, struct drm_framebuffer *fb,
+		 int ret),
+	TP_ARGS(ms912x, fb, ret),
+	TP_STRUCT__entry(
+		__field(int, minor)
+		__field(u32, fb)
+		__field(u32, width)
+		__field(u32, height)
+		__field(int, ret)
+	),
+	TP_fast_assign(
+		__entry->minor = MS912X_TRACE_MINOR(ms912x);
+		__entry->fb = fb->base.id;
+		__entry->width = fb->width;
+		__entry->height = fb->height;
+		__entry->ret = ret;
+	),
+	TP_printk("minor=%d fb=%u %ux%u ret=%d", __entry->minor, __entry->fb,
+		  __entry->width, __entry->height, __entry->ret)
+);
+
+DEFINE_EVENT(ms912x_fb_class, ms912x_vmap_begin,
+	TP_PROTO(struct ms912x_device *ms912x, struct drm_framebuffer *fb,
+		 int ret),
+	TP_ARGS(ms912x, fb, ret)
+);
+
+DEFINE_EVENT(ms912x_fb_class, ms912x_vmap_end,
+	TP_PROTO(struct ms912x_device *ms912x, struct drm_framebuffer *fb,
+		 int ret),
+	TP_ARGS(ms912x, fb, ret)
+);
+
+/* @len is the number of bytes the rectangle takes on the wire */
+DECLARE_EVENT_CLASS(ms912x_rect_class,
+	TP_PROTO(struct ms912x_device *ms912x, const struct drm_rect *rect,
+		 size_t len),
+	TP_ARGS(ms912x, rect, len),
+	TP_STRUCT__entry(
+		__field(int, minor)
+		__field(int, x1)
+		__field(int, y1)
+		__field(int, x2)
+		__field(int, y2)
+		__field(size_t, len)
+	),
+	TP_fast_assign(
+		__entry->minor = MS912X_TRACE_MINOR(ms912x);
+		__entry->x1 = rect->x1;
+		__entry->y1 = rect->y1;
+		__entry->x2 = rect->x2;
+		__entry->y2 = rect->y2;
+		__entry->len = len;
+	),
+	TP_printk("minor=%d rect=(%d,%d)-(%d,%d) len=%zu", __entry->minor,
+		  __entry->x1, __entry->y1, __entry->x2, __entry->y2,
+		  __entry->len)
+);
+
+DEFINE_EVENT(ms912x_rect_class, ms912x_damage_begin,
+	TP_PROTO(struct ms912x_device *ms912x, const struct drm_rect *rect,
+		 size_t len),
+	TP_ARGS(ms912x, rect, len)
+);
+
+DEFINE_EVENT(ms912x_rect_class, ms912x_damage_clip,
+	TP_PROTO(struct ms912x_device *ms912x, const struct drm_rect *rect,
+		 size_t len),
+	TP_ARGS(ms912x, rect, len)
+);
+
+DEFINE_EVENT(ms912x_rect_class, ms912x_damage_end,
+	TP_PROTO(struct ms912x_device *ms912x, const struct drm_rect *rect,
+		 size_t len),
+	TP_ARGS(ms912x, rect, len)
+);
+
+DEFINE_EVENT(ms912x_rect_class, ms912x_convert_begin,
+	TP_PROTO(struct ms912x_device *ms912x, const struct drm_rect *rect,
+		 size_t len),
+	TP_ARGS(ms912x, rect, len)
+);
+
+DEFINE_EVENT(ms912x_rect_class, ms912x_convert_end,
+	TP_PROTO(struct ms912x_device *ms912x, const struct drm_rect *rect,
+		 size_t len),
+	TP_ARGS(ms912x, rect, len)
+);
+
+DECLARE_EVENT_CLASS(ms912x_urb_class,
+	TP_PROTO(struct ms912x_usb_request *request, int status),
+	TP_ARGS(request, status),
+	TP_STRUCT__entry(
+		__field(int, minor)
+		__field(int, index)
+		__field(u32, len)
+		__field(int, status)
+	),
+	TP_fast_assign(
+		__entry->minor = MS912X_TRACE_MINOR(request->ms912x);
+		__entry->index = request - request->ms912x->requests;
+		__entry->len = request->urb->transfer_buffer_length;
+		__entry->status = status;
+	),
+	TP_printk("minor=%d urb=%d len=%u status=%d", __entry->minor,
+		  __entry->index, __entry->len, __entry->status)
+);
+
+DEFINE_EVENT(ms912x_urb_class, ms912x_urb_submit,
+	TP_PROTO(struct ms912x_usb_request *request, int ret),
+	TP_ARGS(request, ret)
+);
+
+DEFINE_EVENT(ms912x_urb_class, ms912x_urb_complete,
+	TP_PROTO(struct ms912x_usb_request *request, int status),
+	TP_ARGS(request, status)
+);
+
+TRACE_EVENT(ms912x_reg_write,
+	TP_PROTO(struct ms912x_device *ms912x, u8 address, const u8 *data,
+		 int ret),
+	TP_ARGS(ms912x, address, data, ret),
+	TP_STRUCT__entry(
+		__field(int, minor)
+		__field(u8, address)
+		__array(u8, data, 6)
+		__field(int, ret)
+	),
+	TP_fast_assign(
+		__entry->minor = MS912X_TRACE_MINOR(ms912x);
+		__entry->address = address;
+		memcpy(__entry->data, data, 6);
+		__entry->ret = ret;
+	),
+	TP_printk("minor=%d reg=%02x data=%6phN ret=%d", __entry->minor,
+		  __entry->address, __entry->data, __entry->ret)
+);
+
+DECLARE_EVENT_CLASS(ms912x_edid_class,
+	TP_PROTO(struct ms912x_device *ms912x, unsigned int block, size_t len,
+		 int ret),
+	TP_ARGS(ms912x, block, len, ret),
+	TP_STRUCT__entry(
+		__field(int, minor)
+		__field(unsigned int, block)
+		__field(size_t, len)
+		__field(int, ret)
+	),
+	TP_fast_assign(
+		__entry->minor = MS912X_TRACE_MINOR(ms912x);
+		__entry->block = block;
+		__entry->len = len;
+		__entry->ret = ret;
+	),
+	TP_printk("minor=%d block=%u len=%zu ret=%d", __entry->minor,
+		  __entry->block, __entry->len, __entry->ret)
+);
+
+DEFINE_EVENT(ms912x_edid_class, ms912x_edid_read_begin,
+	TP_PROTO(struct ms912x_device *ms912x, unsigned int block, size_t len,
+		 int ret),
+	TP_ARGS(ms912x, block, len, ret)
+);
+
+DEFINE_EVENT(ms912x_edid_class, ms912x_edid_read_end,
+	TP_PROTO(struct ms912x_device *ms912x, unsigned int block, size_t len,
+		 int ret),
+	TP_ARGS(ms912x, block, len, ret)
+);
+
+#endif /* MS912X_TRACE_H */
+
+/* Found through -I$(src), see the Makefile */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE ms912x_trace
+
+#include <trace/define_trace.h>
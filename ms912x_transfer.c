@@ -1,35 +1,732 @@
 #include <linux/usb.h>
 #include <linux/jiffies.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+
+#include <drm/drm_fourcc.h>
+#include <drm/drm_gem_framebuffer_helper.h>
+#include <drm/drm_gem_shmem_helper.h>
 
 #include "ms912x.h"
+#include "ms912x_trace.h"
+
+#define MS912X_REQUEST_TIMEOUT_MS 5000
+
+static bool zero_copy = true;
+module_param(zero_copy, bool, 0644);
+MODULE_PARM_DESC(zero_copy, "Send imported UYVY framebuffers straight from their pages (default: true)");
+
+static void ms912x_request_complete(struct urb *urb)
+{
+	struct ms912x_usb_request *request = urb->context;
+	struct ms912x_device *ms912x = request->ms912x;
+	struct ms912x_plane_state *plane = request->plane;
+	struct drm_pending_vblank_event *event = NULL;
+	ktime_t now = ktime_get();
+	unsigned long flags;
+	bool waiting;
+
+	trace_ms912x_urb_complete(request, urb->status);
+
+	switch (urb->status) {
+	case 0:
+		ms912x_stats_hist(&ms912x->stats, MS912X_HIST_URB_LATENCY_US,
+				  ktime_us_delta(now, request->submitted_at));
+		break;
+	case -ENOENT:
+	case -ECONNRESET:
+	case -ESHUTDOWN:
+		break;
+	case -ETIMEDOUT:
+		ms912x_stats_inc(&ms912x->stats, MS912X_STAT_BULK_TIMEOUTS);
+		fallthrough;
+	default:
+		ms912x_stats_inc(&ms912x->stats, MS912X_STAT_BULK_ERRORS);
+		dev_err_ratelimited(&ms912x->intf->dev,
+				    "bulk transfer failed: %d\n", urb->status);
+		break;
+	}
+
+	/* Bulk URBs complete in order, failed and killed ones included */
+	request->plane = NULL;
+	spin_lock_irqsave(&ms912x->requests_lock, flags);
+	list_add_tail(&request->node, &ms912x->free_requests);
+	ms912x_governor_done(&ms912x->governor, request, now);
+	if (++ms912x->urbs_completed >= ms912x->flip_seq) {
+		event = ms912x->flip_event;
+		ms912x->flip_event = NULL;
+	}
+	waiting = ms912x->sched_waiting;
+	ms912x->sched_waiting = false;
+	spin_unlock_irqrestore(&ms912x->requests_lock, flags);
+	atomic64_sub(urb->transfer_buffer_length, &ms912x->bus_share->backlog);
+
+	wake_up(&ms912x->requests_wait);
+	/* The worker let the neighbours go, see ms912x_sched_over_share() */
+	if (waiting)
+		ms912x_sched_queue(ms912x, 0);
+	ms912x_send_vblank_event(ms912x, event);
+	if (plane)
+		ms912x_plane_state_put_async(plane);
+}
+
+/**
+ * ms912x_init_requests - preallocate the bulk URB pool
+ * @ms912x: device handle
+ *
+ * Every request owns a coherent buffer of MS912X_MAX_TRANSFER_LENGTH bytes
+ * so the update path never allocates while a frame is being sent, and a
+ * small page backed one for the framing of zero-copy sends.
+ */
+int ms912x_init_requests(struct ms912x_device *ms912x)
+{
+	struct usb_device *udev = interface_to_usbdev(ms912x->intf);
+	struct ms912x_usb_request *request;
+	void *buffer;
+	int i;
+
+	INIT_LIST_HEAD(&ms912x->free_requests);
+	spin_lock_init(&ms912x->requests_lock);
+	init_waitqueue_head(&ms912x->requests_wait);
+	init_usb_anchor(&ms912x->submitted);
+
+	for (i = 0; i < MS912X_TOTAL_URBS; i++) {
+		request = &ms912x->requests[i];
+		request->ms912x = ms912x;
+
+		request->sg_buf = kmalloc(MS912X_UPDATE_OVERHEAD, GFP_KERNEL);
+		if (!request->sg_buf)
+			goto err_free;
+
+		request->urb = usb_alloc_urb(0, GFP_KERNEL);
+		if (!request->urb)
+			goto err_free;
+
+		buffer = usb_alloc_coherent(udev, MS912X_MAX_TRANSFER_LENGTH,
+					    GFP_KERNEL, &request->dma);
+		if (!buffer) {
+			usb_free_urb(request->urb);
+			request->urb = NULL;
+			goto err_free;
+		}
+		request->buf = buffer;
+		request->urb->transfer_dma = request->dma;
+
+		usb_fill_bulk_urb(request->urb, udev,
+				  usb_sndbulkpipe(udev, 0x04), buffer,
+				  MS912X_MAX_TRANSFER_LENGTH,
+				  ms912x_request_complete, request);
+		request->urb->transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
+		list_add_tail(&request->node, &ms912x->free_requests);
+	}
+
+	return 0;
+
+err_free:
+	ms912x_free_requests(ms912x);
+	return -ENOMEM;
+}
+
+/**
+ * ms912x_free_requests - release the bulk URB pool
+ * @ms912x: device handle
+ *
+ * Outstanding URBs are killed first so no completion handler can run on a
+ * request that is being freed.  The encode buffer goes with the pool.
+ */
+void ms912x_free_requests(struct ms912x_device *ms912x)
+{
+	struct usb_device *udev = interface_to_usbdev(ms912x->intf);
+	struct ms912x_usb_request *request;
+	int i;
+
+	ms912x_kill_requests(ms912x);
+
+	for (i = 0; i < MS912X_TOTAL_URBS; i++) {
+		request = &ms912x->requests[i];
+		kfree(request->sg_buf);
+		request->sg_buf = NULL;
+		if (!request->urb)
+			continue;
+
+		usb_free_coherent(udev, MS912X_MAX_TRANSFER_LENGTH,
+				  request->buf, request->dma);
+		usb_free_urb(request->urb);
+		request->urb = NULL;
+	}
+	INIT_LIST_HEAD(&ms912x->free_requests);
+
+	kvfree(ms912x->encode_buf);
+	ms912x->encode_buf = NULL;
+	ms912x->encode_buf_size = 0;
+}
+
+/**
+ * ms912x_kill_requests - cancel all in-flight bulk transfers
+ * @ms912x: device handle
+ */
+void ms912x_kill_requests(struct ms912x_device *ms912x)
+{
+	usb_kill_anchored_urbs(&ms912x->submitted);
+}
+
+static struct ms912x_usb_request *
+ms912x_get_request(struct ms912x_device *ms912x)
+{
+	struct ms912x_usb_request *request = NULL;
+	long ret;
+
+	ret = wait_event_timeout(ms912x->requests_wait,
+				 !list_empty(&ms912x->free_requests),
+				 msecs_to_jiffies(MS912X_REQUEST_TIMEOUT_MS));
+	if (!ret) {
+		ms912x_stats_inc(&ms912x->stats, MS912X_STAT_BULK_TIMEOUTS);
+		return ERR_PTR(-ETIMEDOUT);
+	}
+
+	spin_lock_irq(&ms912x->requests_lock);
+	if (!list_empty(&ms912x->free_requests)) {
+		request = list_first_entry(&ms912x->free_requests,
+					   struct ms912x_usb_request, node);
+		list_del(&request->node);
+	}
+	spin_unlock_irq(&ms912x->requests_lock);
+
+	/* Lost a race with another submitter, the caller retries */
+	if (!request)
+		return ERR_PTR(-EAGAIN);
+
+	/* Back to the coherent buffer if the last user was a zero-copy send */
+	request->urb->transfer_buffer = request->buf;
+	request->urb->transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
+	request->urb->sg = NULL;
+	request->urb->num_sgs = 0;
+	request->urb->num_mapped_sgs = 0;
+	return request;
+}
+
+static void ms912x_put_request(struct ms912x_device *ms912x,
+			       struct ms912x_usb_request *request)
+{
+	if (request->plane) {
+		ms912x_plane_state_put(request->plane);
+		request->plane = NULL;
+	}
+
+	spin_lock_irq(&ms912x->requests_lock);
+	list_add_tail(&request->node, &ms912x->free_requests);
+	spin_unlock_irq(&ms912x->requests_lock);
+	wake_up(&ms912x->requests_wait);
+}
+
+static int ms912x_submit_request(struct ms912x_device *ms912x,
+				 struct ms912x_usb_request *request,
+				 size_t len)
+{
+	int ret;
+
+	request->urb->transfer_buffer_length = len;
+	request->submitted_at = ktime_get();
+
+	/* Counted up front, the completion may run before submit returns */
+	spin_lock_irq(&ms912x->requests_lock);
+	ms912x->urbs_submitted++;
+	ms912x->governor.bytes_queued += len;
+	spin_unlock_irq(&ms912x->requests_lock);
+	atomic64_add(len, &ms912x->bus_share->backlog);
+
+	usb_anchor_urb(request->urb, &ms912x->submitted);
+	ret = usb_submit_urb(request->urb, GFP_KERNEL);
+	trace_ms912x_urb_submit(request, ret);
+	if (!ret) {
+		ms912x_stats_inc(&ms912x->stats, MS912X_STAT_BULK_URBS);
+		ms912x_stats_add(&ms912x->stats, MS912X_STAT_BULK_BYTES, len);
+	} else {
+		usb_unanchor_urb(request->urb);
+		spin_lock_irq(&ms912x->requests_lock);
+		ms912x->urbs_submitted--;
+		ms912x->governor.bytes_queued -= len;
+		spin_unlock_irq(&ms912x->requests_lock);
+		atomic64_sub(len, &ms912x->bus_share->backlog);
+		ms912x_put_request(ms912x, request);
+	}
+	return ret;
+}
+
+/*
+ * Queues the tiles ms912x_shadow_band() packed.  They are copied into the
+ * preallocated pool in chunks of at most MS912X_MAX_TRANSFER_LENGTH bytes and
+ * every chunk is submitted as soon as it is filled.  Only sleeps while waiting
+ * for a free URB and does not wait for the last chunks to complete.
+ */
+static int ms912x_transfer_framebuffer(struct ms912x_device *ms912x,
+				       const void *vaddr, size_t size)
+{
+	struct ms912x_usb_request *request;
+	size_t offset = 0, len;
+	int ret;
+
+	if (!vaddr || !size)
+		return -EINVAL;
+
+	while (offset < size) {
+		request = ms912x_get_request(ms912x);
+		if (IS_ERR(request)) {
+			if (PTR_ERR(request) == -EAGAIN)
+				continue;
+			dev_err(&ms912x->intf->dev,
+				"no free bulk request, dropping frame\n");
+			return PTR_ERR(request);
+		}
+
+		len = min_t(size_t, size - offset, MS912X_MAX_TRANSFER_LENGTH);
+		memcpy(request->urb->transfer_buffer, vaddr + offset, len);
+
+		ret = ms912x_submit_request(ms912x, request, len);
+		if (ret) {
+			dev_err(&ms912x->intf->dev,
+				"bulk submit failed: %d\n", ret);
+			return ret;
+		}
+		offset += len;
+		ms912x->frame_bytes += len;
+	}
+
+	dev_dbg(&ms912x->intf->dev, "framebuffer queued: %zu bytes\n", size);
+	return 0;
+}
+
+static int ms912x_reserve_encode_buf(struct ms912x_device *ms912x, size_t size)
+{
+	void *buf;
+
+	if (ms912x->encode_buf_size >= size)
+		return 0;
+
+	buf = kvmalloc(size, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	kvfree(ms912x->encode_buf);
+	ms912x->encode_buf = buf;
+	ms912x->encode_buf_size = size;
+	return 0;
+}
+
+/*
+ * Without a shadow every chunk of a band is converted straight into its own
+ * URB buffer, wrapped into a frame update of its own and submitted.
+ */
+static int ms912x_stream_band(struct ms912x_device *ms912x,
+			      struct drm_framebuffer *fb, const void *vaddr,
+			      const struct drm_rect *band,
+			      unsigned int chunk_lines)
+{
+	struct ms912x_usb_request *requests[MS912X_MAX_STRIPES];
+	unsigned int pix_fmt = ms912x->shadow.pix_fmt;
+	struct ms912x_stripe *stripe;
+	unsigned int i, n = 0;
+	struct drm_rect chunk;
+	size_t len, total = 0;
+	u64 start;
+	u8 *buf;
+	int ret = 0;
+
+	for (chunk = *band; chunk.y1 < band->y2; chunk.y1 = chunk.y2) {
+		chunk.y2 = min(chunk.y1 + (int)chunk_lines, band->y2);
+
+		do {
+			requests[n] = ms912x_get_request(ms912x);
+		} while (requests[n] == ERR_PTR(-EAGAIN));
+		if (IS_ERR(requests[n])) {
+			dev_err(&ms912x->intf->dev,
+				"no free bulk request, dropping frame\n");
+			ret = PTR_ERR(requests[n]);
+			goto err_put;
+		}
+
+		buf = requests[n]->urb->transfer_buffer;
+		ms912x_pack_header(buf, &chunk);
+		ms912x_stripe_set(ms912x, n, buf +
+				  sizeof(struct ms912x_frame_update_header),
+				  vaddr, fb, pix_fmt, &chunk);
+		n++;
+	}
+
+	trace_ms912x_convert_begin(ms912x, band, 0);
+	start = ktime_get_ns();
+	ms912x_stripes_run(ms912x, n);
+
+	for (i = 0; i < n; i++) {
+		stripe = &ms912x->stripes[i];
+		ms912x_blend_cursor(stripe->dst, pix_fmt, &stripe->rect,
+				    &ms912x->cursor);
+		len = ms912x_encoded_size(&stripe->rect, pix_fmt);
+		ms912x_pack_end(requests[i]->urb->transfer_buffer + len -
+				MS912X_END_LENGTH);
+		total += len;
+	}
+	ms912x->frame_convert_ns += ktime_get_ns() - start;
+	trace_ms912x_convert_end(ms912x, band, total);
+
+	for (i = 0; i < n && !ret; i++) {
+		len = ms912x_encoded_size(&ms912x->stripes[i].rect, pix_fmt);
+		ret = ms912x_submit_request(ms912x, requests[i], len);
+		if (ret)
+			dev_err(&ms912x->intf->dev,
+				"bulk submit failed: %d\n", ret);
+		else
+			ms912x->frame_bytes += len;
+	}
+
+	/* A failed submit already returned its own request */
+	for (; i < n; i++)
+		ms912x_put_request(ms912x, requests[i]);
+	return ret;
+
+err_put:
+	while (n--)
+		ms912x_put_request(ms912x, requests[n]);
+	return ret;
+}
+
+/*
+ * With a shadow the band is converted into the encode buffer, and only the
+ * tiles that differ from what the device shows are packed and sent.
+ */
+static int ms912x_shadow_band(struct ms912x_device *ms912x,
+			      struct drm_framebuffer *fb, const void *vaddr,
+			      const struct drm_rect *band, unsigned int n)
+{
+	struct ms912x_shadow *shadow = &ms912x->shadow;
+	size_t payload_len, len;
+	u8 *packed;
+	u64 start;
+	int ret;
+
+	payload_len = (size_t)drm_rect_width(band) * drm_rect_height(band) *
+		      ms912x_pixfmt_bpp(shadow->pix_fmt);
+	ret = ms912x_reserve_encode_buf(ms912x, payload_len +
+					ms912x_shadow_max_packed(shadow, band));
+	if (ret)
+		return ret;
+
+	trace_ms912x_convert_begin(ms912x, band, 0);
+	start = ktime_get_ns();
+	ms912x_encode_stripes(ms912x, ms912x->encode_buf, vaddr, fb,
+			      shadow->pix_fmt, band, n);
+	ms912x_blend_cursor(ms912x->encode_buf, shadow->pix_fmt, band,
+			    &ms912x->cursor);
+	ms912x->frame_convert_ns += ktime_get_ns() - start;
+	trace_ms912x_convert_end(ms912x, band, payload_len);
+
+	packed = ms912x->encode_buf + payload_len;
+	len = ms912x_shadow_pack(shadow, packed, ms912x->encode_buf, band);
+	if (!len)
+		return 0;
+
+	return ms912x_transfer_framebuffer(ms912x, packed, len);
+}
+
+/**
+ * ms912x_fb_send_rect - encode and queue one damaged rectangle
+ * @ms912x: device handle
+ * @fb:     framebuffer the rectangle belongs to
+ * @vaddr:  CPU mapping of the framebuffer
+ * @rect:   damaged area, aligned in place to the device granularity
+ *
+ * The rectangle is streamed in bands of as many URB-sized chunks as there
+ * are conversion stripes.  Each band is submitted as soon as it is
+ * converted, so the bus sends one band while the next is being converted.
+ * Must be called from the update worker, which owns the encode buffer, the
+ * stripes and the shadow.
+ */
+int ms912x_fb_send_rect(struct ms912x_device *ms912x,
+			struct drm_framebuffer *fb, const void *vaddr,
+			struct drm_rect *rect)
+{
+	unsigned int chunk_lines, n;
+	struct drm_rect band;
+	int ret;
+
+	if (!ms912x_align_rect(rect, fb->width, fb->height))
+		return 0;
+
+	chunk_lines = ms912x_chunk_lines(rect, ms912x->shadow.pix_fmt,
+					 MS912X_MAX_TRANSFER_LENGTH);
+	n = ms912x_stripes_count(ms912x, rect);
+
+	/* Leave half of the pool for the bus while a band is converted */
+	if (ms912x->shadow.mode == MS912X_SHADOW_OFF)
+		n = min_t(unsigned int, n, MS912X_TOTAL_URBS / 2);
+
+	for (band = *rect; band.y1 < rect->y2; band.y1 = band.y2) {
+		band.y2 = min(band.y1 + (int)(chunk_lines * n), rect->y2);
+
+		if (ms912x->shadow.mode == MS912X_SHADOW_OFF)
+			ret = ms912x_stream_band(ms912x, fb, vaddr, &band,
+						 chunk_lines);
+		else
+			ret = ms912x_shadow_band(ms912x, fb, vaddr, &band,
+						 min_t(unsigned int, n,
+						       drm_rect_height(&band)));
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/**
+ * ms912x_fb_zero_copy_sgt - check whether a framebuffer can skip the encoder
+ * @ms912x: device handle
+ * @fb:     framebuffer to send
+ *
+ * With the device in UYVY mode, a UYVY framebuffer without padding
+ * between lines already holds the payload of a full width frame update.
+ * If it was imported from pages, they can be handed to the host controller
+ * as they are.
+ *
+ * Returns the scatterlist of @fb, or NULL if it has to go through the
+ * encoder.
+ */
+struct sg_table *ms912x_fb_zero_copy_sgt(struct ms912x_device *ms912x,
+					 struct drm_framebuffer *fb)
+{
+	struct usb_device *udev = interface_to_usbdev(ms912x->intf);
+	struct drm_gem_object *obj = drm_gem_fb_get_obj(fb, 0);
+	struct scatterlist *sg;
+	struct sg_table *sgt;
+	unsigned int i;
+
+	if (!zero_copy || !obj || !obj->import_attach ||
+	    ms912x->shadow.pix_fmt != MS912X_PIXFMT_UYVY)
+		return NULL;
+
+	if (fb->format->format != DRM_FORMAT_UYVY || fb->offsets[0] ||
+	    fb->pitches[0] != fb->width * MS912X_UYVY_BPP ||
+	    !IS_ALIGNED(fb->width, MS912X_TILE_WIDTH))
+		return NULL;
+
+	/*
+	 * Header and end sequence are sg entries of a few bytes, which only
+	 * controllers without constraints on the entry length accept.
+	 */
+	if (!udev->bus->no_sg_constraint ||
+	    udev->bus->sg_tablesize < MS912X_URB_SGS)
+		return NULL;
+
+	/*
+	 * The HCD maps the pages itself, and may bounce entries it cannot
+	 * align through the CPU.  VRAM and the like have no pages for that.
+	 */
+	sgt = to_drm_gem_shmem_obj(obj)->sgt;
+	if (!sgt)
+		return NULL;
+	for_each_sgtable_sg(sgt, sg, i)
+		if (!sg_page(sg))
+			return NULL;
+
+	return sgt;
+}
+
+/* A request whose scatterlist is being filled by ms912x_fb_send_sg() */
+struct ms912x_sg_urb {
+	struct ms912x_usb_request *request;
+	struct ms912x_plane_state *plane;
+	unsigned int num_sgs;
+	size_t len;
+};
+
+static int ms912x_sg_begin(struct ms912x_device *ms912x,
+			   struct ms912x_sg_urb *sg_urb)
+{
+	struct ms912x_usb_request *request;
+
+	do {
+		request = ms912x_get_request(ms912x);
+	} while (request == ERR_PTR(-EAGAIN));
+	if (IS_ERR(request)) {
+		dev_err(&ms912x->intf->dev,
+			"no free bulk request, dropping frame\n");
+		return PTR_ERR(request);
+	}
+
+	/* Dropped when the URB completes, see ms912x_request_complete() */
+	kref_get(&sg_urb->plane->ref);
+	request->plane = sg_urb->plane;
+
+	sg_init_table(request->sg, MS912X_URB_SGS);
+	sg_urb->request = request;
+	sg_urb->num_sgs = 0;
+	sg_urb->len = 0;
+	return 0;
+}
+
+static int ms912x_sg_submit(struct ms912x_device *ms912x,
+			    struct ms912x_sg_urb *sg_urb)
+{
+	struct ms912x_usb_request *request = sg_urb->request;
+	struct urb *urb = request->urb;
+	int ret;
+
+	sg_urb->request = NULL;
+	sg_mark_end(&request->sg[sg_urb->num_sgs - 1]);
+
+	/* Mapped by the HCD, the coherent buffer is not part of this one */
+	urb->transfer_buffer = NULL;
+	urb->transfer_flags &= ~URB_NO_TRANSFER_DMA_MAP;
+	urb->sg = request->sg;
+	urb->num_sgs = sg_urb->num_sgs;
+	urb->num_mapped_sgs = 0;
+
+	ret = ms912x_submit_request(ms912x, request, sg_urb->len);
+	if (ret) {
+		dev_err(&ms912x->intf->dev, "bulk submit failed: %d\n", ret);
+		return ret;
+	}
+	ms912x->frame_bytes += sg_urb->len;
+	return 0;
+}
+
+/* Appends one segment, moving on to a new request when this one is full */
+static int ms912x_sg_add(struct ms912x_device *ms912x,
+			 struct ms912x_sg_urb *sg_urb, struct page *page,
+			 unsigned int len, unsigned int offset)
+{
+	int ret;
+
+	if (sg_urb->num_sgs == MS912X_URB_SGS) {
+		ret = ms912x_sg_submit(ms912x, sg_urb);
+		if (!ret)
+			ret = ms912x_sg_begin(ms912x, sg_urb);
+		if (ret)
+			return ret;
+	}
+
+	sg_set_page(&sg_urb->request->sg[sg_urb->num_sgs++], page, len,
+		    offset);
+	sg_urb->len += len;
+	return 0;
+}
+
+static int ms912x_sg_add_buf(struct ms912x_device *ms912x,
+			     struct ms912x_sg_urb *sg_urb, const void *buf,
+			     unsigned int len)
+{
+	return ms912x_sg_add(ms912x, sg_urb, virt_to_page(buf), len,
+			     offset_in_page(buf));
+}
+
+/**
+ * ms912x_fb_send_sg - queue full width lines straight from the framebuffer
+ * @ms912x: device handle
+ * @plane:  primary plane state showing the framebuffer
+ * @sgt:    scatterlist from ms912x_fb_zero_copy_sgt()
+ * @rect:   damaged area, aligned in place to the device granularity
+ *
+ * The header and the end sequence are written to the small buffers of the
+ * requests, the payload entries point into the pages of @sgt.  Aligned,
+ * @rect must span the whole width of the framebuffer.  Every URB holds a
+ * reference to @plane until it completes, so nothing has to wait for them.
+ */
+int ms912x_fb_send_sg(struct ms912x_device *ms912x,
+		      struct ms912x_plane_state *plane, struct sg_table *sgt,
+		      struct drm_rect *rect)
+{
+	struct drm_framebuffer *fb = plane->base.base.fb;
+	struct ms912x_sg_urb sg_urb = { .plane = plane };
+	size_t offset, remaining, len;
+	struct scatterlist *sg;
+	unsigned int i;
+	u8 *buf;
+	int ret;
+
+	if (!ms912x_align_rect(rect, fb->width, fb->height))
+		return 0;
+
+	if (WARN_ON(rect->x1 || rect->x2 != fb->width))
+		return -EINVAL;
+
+	offset = (size_t)rect->y1 * fb->pitches[0];
+	remaining = (size_t)drm_rect_height(rect) * fb->pitches[0];
+
+	ret = ms912x_sg_begin(ms912x, &sg_urb);
+	if (ret)
+		return ret;
+
+	buf = sg_urb.request->sg_buf;
+	ms912x_pack_header(buf, rect);
+	ret = ms912x_sg_add_buf(ms912x, &sg_urb, buf,
+				sizeof(struct ms912x_frame_update_header));
+	if (ret)
+		goto err;
+
+	for_each_sgtable_sg(sgt, sg, i) {
+		if (!remaining)
+			break;
+
+		len = sg->length;
+		if (offset >= len) {
+			offset -= len;
+			continue;
+		}
+
+		len = min(len - offset, remaining);
+		ret = ms912x_sg_add(ms912x, &sg_urb, sg_page(sg), len,
+				    sg->offset + offset);
+		if (ret)
+			goto err;
+		offset = 0;
+		remaining -= len;
+	}
+
+	if (WARN_ON(remaining)) {
+		ret = -EINVAL;
+		goto err;
+	}
+
+	/* Behind the header, which may share the request */
+	buf = sg_urb.request->sg_buf +
+	      sizeof(struct ms912x_frame_update_header);
+	ms912x_pack_end(buf);
+	ret = ms912x_sg_add_buf(ms912x, &sg_urb, buf, MS912X_END_LENGTH);
+	if (ret)
+		goto err;
+
+	return ms912x_sg_submit(ms912x, &sg_urb);
+
+err:
+	/* Nothing of it was submitted yet, hand the request back */
+	if (sg_urb.request)
+		ms912x_put_request(ms912x, sg_urb.request);
+	return ret;
+}
 
 /**
- * ms912x_transfer_framebuffer - send framebuffer to device over USB
+ * ms912x_queue_flip - complete a flip once the frame is on the device
  * @ms912x: device handle
- * @vaddr:   CPU mapped framebuffer address
- * @size:    number of bytes to transfer
+ * @event:  flip event of the frame just queued, may be NULL
  *
- * This helper pushes a complete framebuffer to the adapter using a synchronous
- * bulk transfer.  It is intentionally minimal so the driver can operate on
- * systems lacking the shadow plane helpers.
+ * @event is armed for the next vblank when the last URB submitted so far
+ * completes, or right away if the bus is idle.  An older flip still waiting
+ * for its URBs is completed now, the frame after it supersedes it anyway.
  */
-int ms912x_transfer_framebuffer(struct ms912x_device *ms912x,
-                                const void *vaddr, size_t size)
+void ms912x_queue_flip(struct ms912x_device *ms912x,
+		       struct drm_pending_vblank_event *event)
 {
-    struct usb_device *udev = interface_to_usbdev(ms912x->intf);
-    unsigned int actual = 0;
-    int ret;
+	struct drm_pending_vblank_event *done = event;
 
-    if (!vaddr || !size)
-        return -EINVAL;
+	if (!event)
+		return;
 
-    ret = usb_bulk_msg(udev, usb_sndbulkpipe(udev, 0x04),
-                       (void *)vaddr, size, &actual,
-                       msecs_to_jiffies(5000));
-    if (ret)
-        dev_err(&udev->dev, "bulk transfer failed: %d\n", ret);
-    else
-        dev_dbg(&udev->dev, "framebuffer transferred: %u bytes\n", actual);
+	spin_lock_irq(&ms912x->requests_lock);
+	if (ms912x->urbs_completed < ms912x->urbs_submitted) {
+		done = ms912x->flip_event;
+		ms912x->flip_event = event;
+		ms912x->flip_seq = ms912x->urbs_submitted;
+	}
+	spin_unlock_irq(&ms912x->requests_lock);
 
-    return ret;
+	ms912x_send_vblank_event(ms912x, done);
 }
@@ -0,0 +1,507 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Encode worker.  The commit path posts the newest framebuffer and its
+ * damage into a single-slot mailbox and returns.  The device's work item on
+ * the shared scheduler picks the mailbox up, encodes the damaged area and
+ * submits it.  While the worker is busy, newer commits replace the
+ * framebuffer in the mailbox and add their damage to it, so a slow bus
+ * drops stale frames instead of building up a queue of them.  How often the
+ * worker may run is up to the governor, see ms912x_governor.c, and to the
+ * scheduler, see ms912x_sched.c.
+ */
+
+#include <drm/drm_drv.h>
+#include <drm/drm_fourcc.h>
+#include <drm/drm_framebuffer.h>
+#include <drm/drm_gem_framebuffer_helper.h>
+#include <drm/drm_print.h>
+
+#include "ms912x.h"
+#include "ms912x_trace.h"
+
+/**
+ * ms912x_plane_state_vmap - map the framebuffer of a primary plane state
+ * @ms912x: device handle
+ * @state:  plane state, stays mapped until it is freed
+ *
+ * Does nothing if @state is mapped already.
+ */
+int ms912x_plane_state_vmap(struct ms912x_device *ms912x,
+			    struct ms912x_plane_state *state)
+{
+	struct drm_framebuffer *fb = state->base.base.fb;
+	int ret;
+
+	if (!iosys_map_is_null(&state->base.map[0]))
+		return 0;
+
+	trace_ms912x_vmap_begin(ms912x, fb, 0);
+	ret = drm_gem_fb_vmap(fb, state->base.map, state->base.data);
+	trace_ms912x_vmap_end(ms912x, fb, ret);
+	if (ret) {
+		drm_err(&ms912x->drm, "vmap failed: %d\n", ret);
+		return ret;
+	}
+
+	ms912x_stats_inc(&ms912x->stats, MS912X_STAT_FB_VMAPS);
+	return 0;
+}
+
+static void ms912x_plane_state_free(struct ms912x_plane_state *state)
+{
+	struct drm_framebuffer *fb = state->base.base.fb;
+
+	if (fb && !iosys_map_is_null(&state->base.map[0]))
+		drm_gem_fb_vunmap(fb, state->base.map);
+	__drm_gem_destroy_shadow_plane_state(&state->base);
+	kfree(state);
+}
+
+static void ms912x_plane_state_release(struct kref *ref)
+{
+	ms912x_plane_state_free(container_of(ref, struct ms912x_plane_state,
+					     ref));
+}
+
+/**
+ * ms912x_plane_state_put - drop a reference to a primary plane state
+ * @state: plane state, unmapped and freed with the last reference
+ */
+void ms912x_plane_state_put(struct ms912x_plane_state *state)
+{
+	kref_put(&state->ref, ms912x_plane_state_release);
+}
+
+static void ms912x_plane_state_release_async(struct kref *ref)
+{
+	struct ms912x_plane_state *state =
+		container_of(ref, struct ms912x_plane_state, ref);
+	struct ms912x_device *ms912x = to_ms912x(state->base.base.plane->dev);
+
+	llist_add(&state->free_node, &ms912x->released_planes);
+	schedule_work(&ms912x->release_work);
+}
+
+/**
+ * ms912x_plane_state_put_async - drop a reference from a URB completion
+ * @state: plane state, freed from the release work with the last reference
+ *
+ * Unmapping and releasing the framebuffer may sleep.
+ */
+void ms912x_plane_state_put_async(struct ms912x_plane_state *state)
+{
+	kref_put(&state->ref, ms912x_plane_state_release_async);
+}
+
+static void ms912x_release_work(struct work_struct *work)
+{
+	struct ms912x_device *ms912x =
+		container_of(work, struct ms912x_device, release_work);
+	struct ms912x_plane_state *state, *next;
+
+	llist_for_each_entry_safe(state, next,
+				  llist_del_all(&ms912x->released_planes),
+				  free_node)
+		ms912x_plane_state_free(state);
+}
+
+/* Called with the mailbox lock held, after mailbox->plane is set */
+static void ms912x_mailbox_add_clip(struct ms912x_mailbox *mailbox,
+				    const struct drm_rect *clip)
+{
+	struct drm_framebuffer *fb = mailbox->plane->base.base.fb;
+	struct drm_rect *clips = mailbox->clips;
+	unsigned int i;
+
+	/* Repeated or adjacent damage, e.g. a blinking cursor or console */
+	if (mailbox->num_clips == MS912X_MAX_CLIPS)
+		mailbox->num_clips = ms912x_merge_clips(clips,
+							mailbox->num_clips,
+							fb->width, fb->height,
+							mailbox->pix_fmt);
+
+	if (mailbox->num_clips < MS912X_MAX_CLIPS) {
+		clips[mailbox->num_clips++] = *clip;
+		return;
+	}
+
+	/* Out of slots, fall back to a single bounding box */
+	for (i = 1; i < mailbox->num_clips; i++)
+		ms912x_rect_union(&clips[0], &clips[i]);
+	ms912x_rect_union(&clips[0], clip);
+	mailbox->num_clips = 1;
+}
+
+/**
+ * ms912x_post_frame - hand a committed frame to the encode worker
+ * @ms912x:    device handle
+ * @plane:     primary plane state with a mapped framebuffer to show
+ * @clips:     damaged areas of the framebuffer
+ * @num_clips: number of entries in @clips
+ * @event:     flip event, completed once @plane is on the device; may be NULL
+ *
+ * Never waits for the bus.  If the previous frame was not picked up yet it
+ * is dropped in favour of @plane and its damage is kept.
+ */
+void ms912x_post_frame(struct ms912x_device *ms912x,
+		       struct ms912x_plane_state *plane,
+		       const struct drm_rect *clips, unsigned int num_clips,
+		       struct drm_pending_vblank_event *event)
+{
+	struct ms912x_mailbox *mailbox = &ms912x->mailbox;
+	struct drm_pending_vblank_event *stale_event;
+	struct ms912x_plane_state *stale;
+	u64 area = 0;
+	unsigned int i;
+
+	for (i = 0; i < num_clips; i++)
+		area += (u64)drm_rect_width(&clips[i]) * drm_rect_height(&clips[i]);
+	ms912x_stats_inc(&ms912x->stats, MS912X_STAT_FRAMES_COMMITTED);
+	ms912x_stats_hist(&ms912x->stats, MS912X_HIST_DAMAGE_AREA, area);
+
+	kref_get(&plane->ref);
+
+	spin_lock(&mailbox->lock);
+	stale = mailbox->plane;
+	mailbox->plane = plane;
+	mailbox->pix_fmt = ms912x->pix_fmt;
+	stale_event = mailbox->event;
+	mailbox->event = event;
+	for (i = 0; i < num_clips; i++)
+		ms912x_mailbox_add_clip(mailbox, &clips[i]);
+	spin_unlock(&mailbox->lock);
+
+	/* A cursor update reposts the plane state already waiting */
+	if (stale && stale != plane) {
+		ms912x_stats_inc(&ms912x->stats, MS912X_STAT_FRAMES_DROPPED);
+		drm_dbg(&ms912x->drm, "dropping stale frame\n");
+	}
+	if (stale)
+		ms912x_plane_state_put(stale);
+	ms912x_send_vblank_event(ms912x, stale_event);
+
+	/* A frame held back by the governor keeps its deadline */
+	ms912x_sched_queue(ms912x, 0);
+}
+
+/**
+ * ms912x_post_cursor - move or change the cursor drawn into the frames
+ * @ms912x:  device handle
+ * @primary: primary plane state to redraw the cursor area from, may be NULL
+ * @rect:    new cursor position
+ * @visible: whether the cursor is shown
+ * @image:   new ARGB8888 image of @rect's size, NULL to keep the old one
+ * @pitch:   line pitch of @image in bytes
+ * @event:   flip event of a cursor-only commit; may be NULL
+ *
+ * Only the area under the old and the new cursor is sent again.
+ */
+void ms912x_post_cursor(struct ms912x_device *ms912x,
+			struct drm_plane_state *primary,
+			const struct drm_rect *rect, bool visible,
+			const void *image, unsigned int pitch,
+			struct drm_pending_vblank_event *event)
+{
+	struct ms912x_mailbox *mailbox = &ms912x->mailbox;
+	struct ms912x_cursor *cursor = &mailbox->cursor;
+	struct drm_rect clips[2];
+	unsigned int num_clips = 0;
+	int y;
+
+	spin_lock(&mailbox->lock);
+	if (cursor->visible)
+		clips[num_clips++] = cursor->rect;
+	if (visible)
+		clips[num_clips++] = *rect;
+	cursor->rect = *rect;
+	cursor->visible = visible;
+	if (image) {
+		for (y = 0; y < drm_rect_height(rect); y++)
+			memcpy(cursor->image + y * MS912X_CURSOR_SIZE,
+			       image + y * pitch,
+			       drm_rect_width(rect) * sizeof(u32));
+		mailbox->cursor_image_dirty = true;
+	}
+	spin_unlock(&mailbox->lock);
+
+	if (primary && primary->fb && num_clips)
+		ms912x_post_frame(ms912x, to_ms912x_plane_state(primary), clips,
+				  num_clips, event);
+	else
+		ms912x_send_vblank_event(ms912x, event);
+}
+
+/**
+ * ms912x_invalidate_shadow - force the next frame to be sent in full
+ * @ms912x: device handle
+ *
+ * For when the device lost what it was showing, e.g. after a modeset.
+ */
+void ms912x_invalidate_shadow(struct ms912x_device *ms912x)
+{
+	spin_lock(&ms912x->mailbox.lock);
+	ms912x->mailbox.shadow_stale = true;
+	spin_unlock(&ms912x->mailbox.lock);
+}
+
+/* Zero-copy sends whole lines, only worth it if the damage does too */
+static bool ms912x_clips_full_width(struct drm_framebuffer *fb,
+				    struct drm_rect *clips,
+				    unsigned int num_clips)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_clips; i++) {
+		if (!ms912x_align_rect(&clips[i], fb->width, fb->height))
+			continue;
+		if (clips[i].x1 || clips[i].x2 != fb->width)
+			return false;
+	}
+	return true;
+}
+
+/* The URBs keep @plane alive until they complete, nothing waits for them */
+static int ms912x_send_frame_sg(struct ms912x_device *ms912x,
+				struct ms912x_plane_state *plane,
+				struct sg_table *sgt, struct drm_rect *clips,
+				unsigned int num_clips)
+{
+	unsigned int i;
+	int ret = 0;
+
+	for (i = 0; i < num_clips; i++) {
+		ret = ms912x_fb_send_sg(ms912x, plane, sgt, &clips[i]);
+		if (ret)
+			break;
+	}
+	if (!ret)
+		ms912x_stats_inc(&ms912x->stats, MS912X_STAT_FRAMES_ZERO_COPY);
+
+	/*
+	 * The pages never went through the shadow.  Refreshing it would mean
+	 * reading the whole frame back with the CPU, which is what zero-copy
+	 * avoids, so the shadow is dropped instead: a client staying on the
+	 * zero-copy path never needs it, and one falling back to mapped frames
+	 * (cursor shown, damage narrower than the frame) pays one full frame.
+	 */
+	ms912x->shadow.valid = false;
+	return ret;
+}
+
+/* Usually mapped by ms912x_pipe_prepare_fb() already */
+static int ms912x_send_frame_mapped(struct ms912x_device *ms912x,
+				    struct ms912x_plane_state *plane,
+				    struct drm_rect *clips,
+				    unsigned int num_clips)
+{
+	struct drm_framebuffer *fb = plane->base.base.fb;
+	unsigned int i;
+	void *vaddr;
+	int ret;
+
+	ret = ms912x_plane_state_vmap(ms912x, plane);
+	if (ret)
+		return ret;
+	vaddr = plane->base.map[0].vaddr;
+
+	ret = drm_gem_fb_begin_cpu_access(fb, DMA_FROM_DEVICE);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < num_clips; i++) {
+		ret = ms912x_fb_send_rect(ms912x, fb, vaddr, &clips[i]);
+		if (ret)
+			break;
+	}
+	ms912x->shadow.valid = !ret;
+
+	drm_gem_fb_end_cpu_access(fb, DMA_FROM_DEVICE);
+	return ret;
+}
+
+static void ms912x_send_frame(struct ms912x_device *ms912x,
+			      struct ms912x_plane_state *plane,
+			      unsigned int pix_fmt, struct drm_rect *clips,
+			      unsigned int num_clips)
+{
+	struct drm_framebuffer *fb = plane->base.base.fb;
+	struct sg_table *sgt;
+	int ret;
+
+	num_clips = ms912x_merge_clips(clips, num_clips, fb->width, fb->height,
+				       pix_fmt);
+
+	/* Until the shadow holds the whole frame, send all of it */
+	ms912x_shadow_prepare(&ms912x->shadow, fb->width, fb->height,
+			      pix_fmt);
+	if (ms912x->shadow.mode != MS912X_SHADOW_OFF &&
+	    !ms912x->shadow.valid) {
+		clips[0] = DRM_RECT_INIT(0, 0, fb->width, fb->height);
+		num_clips = 1;
+	}
+
+	ms912x->frame_bytes = 0;
+	ms912x->frame_convert_ns = 0;
+
+	/* Pages sent as they are cannot have the cursor drawn in */
+	sgt = ms912x_fb_zero_copy_sgt(ms912x, fb);
+	if (sgt && !ms912x->cursor.visible &&
+	    ms912x_clips_full_width(fb, clips, num_clips))
+		ret = ms912x_send_frame_sg(ms912x, plane, sgt, clips,
+					   num_clips);
+	else
+		ret = ms912x_send_frame_mapped(ms912x, plane, clips,
+					       num_clips);
+
+	ms912x_stats_hist(&ms912x->stats, MS912X_HIST_CONVERT_US,
+			  div_u64(ms912x->frame_convert_ns, NSEC_PER_USEC));
+	if (!ret)
+		ms912x_stats_hist(&ms912x->stats, MS912X_HIST_FRAME_BYTES,
+				  ms912x->frame_bytes);
+
+	ms912x_stats_inc(&ms912x->stats, ret ? MS912X_STAT_FRAMES_FAILED :
+					       MS912X_STAT_FRAMES_SENT);
+}
+
+static void ms912x_update_work(struct work_struct *work)
+{
+	struct ms912x_device *ms912x =
+		container_of(work, struct ms912x_device, update_work.work);
+	struct ms912x_mailbox *mailbox = &ms912x->mailbox;
+	struct drm_rect clips[MS912X_MAX_CLIPS];
+	struct drm_pending_vblank_event *event;
+	struct ms912x_plane_state *plane;
+	unsigned int num_clips, pix_fmt;
+	unsigned long delay;
+	ktime_t start;
+	int idx;
+
+	/*
+	 * Link still busy with the last frame, or the bus with more of ours
+	 * than the neighbours', let the damage pile up
+	 */
+	delay = ms912x_governor_delay(ms912x);
+	if (delay && !ms912x->governor.holding) {
+		ms912x_stats_inc(&ms912x->stats, MS912X_STAT_FRAMES_DEFERRED);
+		ms912x->governor.holding = true;
+	}
+	if (!delay && ms912x_sched_over_share(ms912x))
+		return;
+	if (delay) {
+		ms912x_sched_queue(ms912x, delay);
+		return;
+	}
+	ms912x->governor.holding = false;
+
+	spin_lock(&mailbox->lock);
+	plane = mailbox->plane;
+	event = mailbox->event;
+	pix_fmt = mailbox->pix_fmt;
+	num_clips = mailbox->num_clips;
+	memcpy(clips, mailbox->clips, num_clips * sizeof(clips[0]));
+	mailbox->plane = NULL;
+	mailbox->event = NULL;
+	mailbox->num_clips = 0;
+	if (mailbox->shadow_stale) {
+		ms912x->shadow.valid = false;
+		mailbox->shadow_stale = false;
+	}
+	ms912x->cursor.rect = mailbox->cursor.rect;
+	ms912x->cursor.visible = mailbox->cursor.visible;
+	if (mailbox->cursor_image_dirty) {
+		memcpy(ms912x->cursor.image, mailbox->cursor.image,
+		       sizeof(ms912x->cursor.image));
+		mailbox->cursor_image_dirty = false;
+	}
+	spin_unlock(&mailbox->lock);
+
+	if (!plane)
+		return;
+
+	/* Wakes an autosuspended device, and restarts its idle timer */
+	if (drm_dev_enter(&ms912x->drm, &idx)) {
+		if (!usb_autopm_get_interface(ms912x->intf)) {
+			start = ktime_get();
+			ms912x_send_frame(ms912x, plane, pix_fmt, clips,
+					  num_clips);
+			ms912x_governor_frame_sent(ms912x, start);
+			usb_autopm_put_interface(ms912x->intf);
+		} else {
+			ms912x_stats_inc(&ms912x->stats,
+					 MS912X_STAT_FRAMES_FAILED);
+		}
+		drm_dev_exit(idx);
+	}
+
+	/* Also reached on failure, a client must never wait for a flip */
+	ms912x_queue_flip(ms912x, event);
+	ms912x_plane_state_put(plane);
+}
+
+/**
+ * ms912x_update_init - set up the mailbox and the encode worker
+ * @ms912x: device handle
+ */
+int ms912x_update_init(struct ms912x_device *ms912x)
+{
+	spin_lock_init(&ms912x->mailbox.lock);
+	INIT_DELAYED_WORK(&ms912x->update_work, ms912x_update_work);
+	init_llist_head(&ms912x->released_planes);
+	INIT_WORK(&ms912x->release_work, ms912x_release_work);
+	ms912x_stripes_init(ms912x);
+
+	return ms912x_sched_attach(ms912x);
+}
+
+/**
+ * ms912x_stop_updates - drop any queued frame and cancel in-flight transfers
+ * @ms912x: device handle
+ */
+void ms912x_stop_updates(struct ms912x_device *ms912x)
+{
+	struct ms912x_mailbox *mailbox = &ms912x->mailbox;
+	struct drm_pending_vblank_event *event;
+	struct ms912x_plane_state *plane;
+
+	cancel_delayed_work_sync(&ms912x->update_work);
+
+	/* Completions of the killed URBs must not queue it again */
+	spin_lock_irq(&ms912x->requests_lock);
+	ms912x->sched_waiting = false;
+	spin_unlock_irq(&ms912x->requests_lock);
+
+	spin_lock(&mailbox->lock);
+	plane = mailbox->plane;
+	event = mailbox->event;
+	mailbox->plane = NULL;
+	mailbox->event = NULL;
+	mailbox->num_clips = 0;
+	spin_unlock(&mailbox->lock);
+
+	if (plane)
+		ms912x_plane_state_put(plane);
+	ms912x_send_vblank_event(ms912x, event);
+
+	/* The shadow is ahead of a device that never got these */
+	if (!usb_anchor_empty(&ms912x->submitted))
+		ms912x->shadow.valid = false;
+
+	/* Completes the flip waiting for these, if any */
+	ms912x_kill_requests(ms912x);
+	/* Zero-copy URBs may have left their plane states to it */
+	flush_work(&ms912x->release_work);
+}
+
+/**
+ * ms912x_update_fini - stop the encode worker and free its state
+ * @ms912x: device handle
+ */
+void ms912x_update_fini(struct ms912x_device *ms912x)
+{
+	if (!ms912x->bus_share)
+		return;
+
+	ms912x_stop_updates(ms912x);
+	ms912x_sched_detach(ms912x);
+	ms912x_shadow_free(&ms912x->shadow);
+}
@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Emulated vblank.  The adapter has no vblank interrupt, so an hrtimer
+ * running at the refresh rate of the programmed mode stands in for it.
+ * Flip events are armed on it only once the frame has been transferred,
+ * see ms912x_queue_flip(), so clients are paced by what the adapter can
+ * actually show.
+ */
+
+#include <linux/hrtimer.h>
+
+#include <drm/drm_vblank.h>
+
+#include "ms912x.h"
+#include "ms912x_compat.h"
+
+static enum hrtimer_restart ms912x_vblank_timer(struct hrtimer *timer)
+{
+	struct ms912x_device *ms912x =
+		container_of(timer, struct ms912x_device, vblank_timer);
+
+	if (!drm_crtc_handle_vblank(&ms912x->display_pipe.crtc))
+		return HRTIMER_NORESTART;
+
+	hrtimer_forward_now(timer, ms912x->vblank_period);
+	return HRTIMER_RESTART;
+}
+
+/**
+ * ms912x_vblank_init - set up vblank emulation
+ * @ms912x: device handle
+ *
+ * Must be called after the display pipe is initialised.
+ */
+int ms912x_vblank_init(struct ms912x_device *ms912x)
+{
+	ms912x_hrtimer_setup(&ms912x->vblank_timer, ms912x_vblank_timer,
+			     CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	ms912x->vblank_period = ns_to_ktime(NSEC_PER_SEC / 60);
+
+	return drm_vblank_init(&ms912x->drm, 1);
+}
+
+/**
+ * ms912x_vblank_fini - stop vblank emulation for good
+ * @ms912x: device handle
+ */
+void ms912x_vblank_fini(struct ms912x_device *ms912x)
+{
+	hrtimer_cancel(&ms912x->vblank_timer);
+}
+
+/**
+ * ms912x_vblank_set_rate - pace vblanks at a new refresh rate
+ * @ms912x: device handle
+ * @hz:     refresh rate of the mode being enabled
+ *
+ * Called on modeset while vblanks are off.
+ */
+void ms912x_vblank_set_rate(struct ms912x_device *ms912x, int hz)
+{
+	ms912x->vblank_period = ns_to_ktime(NSEC_PER_SEC / max(hz, 1));
+}
+
+int ms912x_enable_vblank(struct drm_simple_display_pipe *pipe)
+{
+	struct ms912x_device *ms912x = to_ms912x(pipe->crtc.dev);
+
+	hrtimer_start(&ms912x->vblank_timer, ms912x->vblank_period,
+		      HRTIMER_MODE_REL);
+	return 0;
+}
+
+void ms912x_disable_vblank(struct drm_simple_display_pipe *pipe)
+{
+	struct ms912x_device *ms912x = to_ms912x(pipe->crtc.dev);
+
+	/* Called in atomic context, the timer stops itself if this loses */
+	hrtimer_try_to_cancel(&ms912x->vblank_timer);
+}
+
+/**
+ * ms912x_send_vblank_event - complete a flip at the next vblank
+ * @ms912x: device handle
+ * @event:  event taken from the CRTC state, may be NULL
+ *
+ * With vblanks off, e.g. while the pipe is disabled, @event is sent
+ * right away.  Safe to call from URB completion.
+ */
+void ms912x_send_vblank_event(struct ms912x_device *ms912x,
+			      struct drm_pending_vblank_event *event)
+{
+	struct drm_crtc *crtc = &ms912x->display_pipe.crtc;
+	unsigned long flags;
+
+	if (!event)
+		return;
+
+	spin_lock_irqsave(&ms912x->drm.event_lock, flags);
+	if (!drm_crtc_vblank_get(crtc))
+		drm_crtc_arm_vblank_event(crtc, event);
+	else
+		drm_crtc_send_vblank_event(crtc, event);
+	spin_unlock_irqrestore(&ms912x->drm.event_lock, flags);
+}
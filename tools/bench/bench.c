@@ -0,0 +1,639 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Userspace benchmark of the driver's encoding path.  Builds the real
+ * ms912x_frame.c, ms912x_shadow.c and ms912x_convert*.c against the shims in
+ * shim/ and runs them over synthetic workloads at every resolution of
+ * ms912x_mode_list.  See README.md.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <linux/kernel.h>
+#include <drm/drm_fourcc.h>
+
+#include "ms912x_convert.h"
+#include "ms912x_frame.h"
+
+#define MS912X_MODE(w, h, z, ...) { w, h, z }
+
+struct bench_mode {
+	int width;
+	int height;
+	int hz;
+};
+
+/* Generated from ms912x_drv.c by the Makefile */
+static const struct bench_mode bench_modes[] = {
+#include "modes.h"
+};
+
+/* Defined by module_param() in the driver sources, see shim/linux/module.h */
+extern int *ms912x_param_shadow;
+extern bool *ms912x_param_simd;
+
+#define BENCH_MAX_CLIPS 4
+#define BENCH_TRANSFER_LENGTH 65536 /* MS912X_MAX_TRANSFER_LENGTH */
+#define BENCH_KEY_LEN 64
+
+struct bench_fb {
+	u32 *pixels;
+	int width;
+	int height;
+	unsigned int pitch;
+};
+
+struct bench_scenario {
+	const char *name;
+	/* Draws frame @n and reports what a compositor would damage */
+	void (*frame)(struct bench_fb *fb, unsigned int n,
+		      struct drm_rect *clips, unsigned int *num_clips);
+};
+
+struct bench_result {
+	char key[BENCH_KEY_LEN];
+	double ns_px; /* conversion time per converted pixel */
+	double us_frame; /* whole encode path per frame */
+	unsigned long long bytes_frame;
+};
+
+static const char *const bench_shadow_names[] = {
+	[MS912X_SHADOW_OFF] = "off",
+	[MS912X_SHADOW_FRAME] = "frame",
+	[MS912X_SHADOW_CHECKSUM] = "checksum",
+};
+
+static u32 bench_seed;
+
+static u32 bench_random(void)
+{
+	bench_seed ^= bench_seed << 13;
+	bench_seed ^= bench_seed >> 17;
+	bench_seed ^= bench_seed << 5;
+	return bench_seed;
+}
+
+static u64 bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static u32 *bench_pixel(struct bench_fb *fb, int x, int y)
+{
+	return fb->pixels + (size_t)y * fb->width + x;
+}
+
+/* Wallpaper: a smooth gradient, the same for every frame */
+static u32 bench_background(int x, int y)
+{
+	return 0xff000000 | ((x / 4) & 0xff) << 16 | ((y / 4) & 0xff) << 8 |
+	       0x60;
+}
+
+static void bench_fill_background(struct bench_fb *fb, const struct drm_rect *r)
+{
+	int x, y;
+
+	for (y = r->y1; y < r->y2; y++)
+		for (x = r->x1; x < r->x2; x++)
+			*bench_pixel(fb, x, y) = bench_background(x, y);
+}
+
+/* Something that looks like a line of text, 16 pixels high */
+static void bench_fill_text(struct bench_fb *fb, const struct drm_rect *r)
+{
+	int x, y;
+	u32 glyph = 0;
+
+	for (y = r->y1; y < r->y2; y++) {
+		for (x = r->x1; x < r->x2; x++) {
+			if (x % 8 == 0)
+				glyph = bench_random();
+			*bench_pixel(fb, x, y) =
+				glyph >> (y % 16 + x % 8) & 1 ? 0xffd0d0d0 :
+								0xff202020;
+		}
+	}
+}
+
+static void bench_clip_to_fb(struct bench_fb *fb, struct drm_rect *r)
+{
+	r->x1 = max(r->x1, 0);
+	r->y1 = max(r->y1, 0);
+	r->x2 = min(r->x2, fb->width);
+	r->y2 = min(r->y2, fb->height);
+}
+
+/* Nothing moves but a clock, yet the compositor damages the whole screen */
+static void bench_static_desktop(struct bench_fb *fb, unsigned int n,
+				 struct drm_rect *clips,
+				 unsigned int *num_clips)
+{
+	struct drm_rect clock = DRM_RECT_INIT(fb->width - 100, 4, 80, 16);
+
+	bench_fill_text(fb, &clock);
+	clips[0] = DRM_RECT_INIT(0, 0, fb->width, fb->height);
+	*num_clips = 1;
+}
+
+/* Full screen terminal scrolling by one line per frame */
+static void bench_terminal_scroll(struct bench_fb *fb, unsigned int n,
+				  struct drm_rect *clips,
+				  unsigned int *num_clips)
+{
+	struct drm_rect last = DRM_RECT_INIT(0, fb->height - 16, fb->width, 16);
+
+	memmove(fb->pixels, bench_pixel(fb, 0, 16),
+		(size_t)(fb->height - 16) * fb->pitch);
+	bench_fill_text(fb, &last);
+	clips[0] = DRM_RECT_INIT(0, 0, fb->width, fb->height);
+	*num_clips = 1;
+}
+
+/* Every pixel changes every frame */
+static void bench_video(struct bench_fb *fb, unsigned int n,
+			struct drm_rect *clips, unsigned int *num_clips)
+{
+	int x, y;
+	u32 noise = 0;
+
+	for (y = 0; y < fb->height; y++) {
+		for (x = 0; x < fb->width; x++) {
+			if (x % 4 == 0)
+				noise = bench_random();
+			*bench_pixel(fb, x, y) =
+				0xff000000 | ((x + n * 3) & 0xff) << 16 |
+				((y + n) & 0xff) << 8 |
+				(noise >> (x % 4 * 8) & 0x3f);
+		}
+	}
+	clips[0] = DRM_RECT_INIT(0, 0, fb->width, fb->height);
+	*num_clips = 1;
+}
+
+/* A 480x320 window dragged across the screen, old and new place damaged */
+static void bench_window_drag(struct bench_fb *fb, unsigned int n,
+			      struct drm_rect *clips, unsigned int *num_clips)
+{
+	int span_x = max(fb->width - 480, 1), span_y = max(fb->height - 320, 1);
+	struct drm_rect old = DRM_RECT_INIT((n * 24) % span_x, (n * 8) % span_y,
+					    480, 320);
+	struct drm_rect now = DRM_RECT_INIT(((n + 1) * 24) % span_x,
+					    ((n + 1) * 8) % span_y, 480, 320);
+	struct drm_rect line;
+	int y;
+
+	bench_clip_to_fb(fb, &old);
+	bench_clip_to_fb(fb, &now);
+	bench_fill_background(fb, &old);
+
+	/* Same content on every frame, only its position changes */
+	bench_seed = 0x12345678;
+	for (y = now.y1; y < now.y2; y += 16) {
+		line = DRM_RECT_INIT(now.x1, y, drm_rect_width(&now),
+				     min(16, now.y2 - y));
+		bench_fill_text(fb, &line);
+	}
+
+	clips[0] = old;
+	clips[1] = now;
+	*num_clips = 2;
+}
+
+static const struct bench_scenario bench_scenarios[] = {
+	{ "static", bench_static_desktop },
+	{ "scroll", bench_terminal_scroll },
+	{ "video", bench_video },
+	{ "drag", bench_window_drag },
+};
+
+struct bench_encoder {
+	struct ms912x_shadow shadow;
+	u8 *buf;
+	size_t buf_size;
+	u64 convert_ns;
+	u64 converted;
+};
+
+static void *bench_reserve(struct bench_encoder *enc, size_t size)
+{
+	if (enc->buf_size < size) {
+		free(enc->buf);
+		enc->buf = malloc(size);
+		if (!enc->buf) {
+			perror("malloc");
+			exit(1);
+		}
+		enc->buf_size = size;
+	}
+	return enc->buf;
+}
+
+/* Mirrors ms912x_stream_band() and ms912x_shadow_band() */
+static size_t bench_send_band(struct bench_encoder *enc, struct bench_fb *fb,
+			      struct drm_rect *rect)
+{
+	size_t payload_len, len;
+	u64 start;
+
+	if (enc->shadow.mode == MS912X_SHADOW_OFF) {
+		bench_reserve(enc, ms912x_encoded_size(rect,
+						       MS912X_PIXFMT_UYVY));
+		start = bench_now_ns();
+		len = ms912x_encode_rect(enc->buf, fb->pixels, fb->pitch,
+					 fb->width, DRM_FORMAT_XRGB8888,
+					 MS912X_PIXFMT_UYVY, rect);
+		enc->convert_ns += bench_now_ns() - start;
+		enc->converted += (u64)drm_rect_width(rect) * drm_rect_height(rect);
+		return len;
+	}
+
+	payload_len = (size_t)drm_rect_width(rect) * drm_rect_height(rect) *
+		      MS912X_UYVY_BPP;
+	bench_reserve(enc, payload_len +
+				   ms912x_shadow_max_packed(&enc->shadow, rect));
+
+	start = bench_now_ns();
+	ms912x_encode_lines(enc->buf, fb->pixels, fb->pitch, fb->width,
+			    DRM_FORMAT_XRGB8888, MS912X_PIXFMT_UYVY, rect);
+	enc->convert_ns += bench_now_ns() - start;
+	enc->converted += (u64)drm_rect_width(rect) * drm_rect_height(rect);
+
+	return ms912x_shadow_pack(&enc->shadow, enc->buf + payload_len,
+				  enc->buf, rect);
+}
+
+/*
+ * Mirrors ms912x_fb_send_rect() on a single CPU, one URB-sized band at a
+ * time.  Returns what would go on the wire.
+ */
+static size_t bench_send_rect(struct bench_encoder *enc, struct bench_fb *fb,
+			      struct drm_rect *rect)
+{
+	unsigned int chunk_lines;
+	struct drm_rect band;
+	size_t len = 0;
+
+	if (!ms912x_align_rect(rect, fb->width, fb->height))
+		return 0;
+
+	chunk_lines = ms912x_chunk_lines(rect, MS912X_PIXFMT_UYVY,
+					 BENCH_TRANSFER_LENGTH);
+	for (band = *rect; band.y1 < rect->y2; band.y1 = band.y2) {
+		band.y2 = min(band.y1 + (int)chunk_lines, rect->y2);
+		len += bench_send_band(enc, fb, &band);
+	}
+	return len;
+}
+
+/* Mirrors ms912x_send_frame() */
+static size_t bench_send_frame(struct bench_encoder *enc, struct bench_fb *fb,
+			       struct drm_rect *clips, unsigned int num_clips)
+{
+	size_t len = 0;
+	unsigned int i;
+
+	num_clips = ms912x_merge_clips(clips, num_clips, fb->width, fb->height,
+				       MS912X_PIXFMT_UYVY);
+
+	ms912x_shadow_prepare(&enc->shadow, fb->width, fb->height,
+			      MS912X_PIXFMT_UYVY);
+	if (enc->shadow.mode != MS912X_SHADOW_OFF && !enc->shadow.valid) {
+		clips[0] = DRM_RECT_INIT(0, 0, fb->width, fb->height);
+		num_clips = 1;
+	}
+
+	for (i = 0; i < num_clips; i++)
+		len += bench_send_rect(enc, fb, &clips[i]);
+	enc->shadow.valid = true;
+
+	return len;
+}
+
+static void bench_run_scenario(const struct bench_scenario *scenario,
+			       const struct bench_mode *mode,
+			       enum ms912x_shadow_mode shadow_mode,
+			       unsigned int frames, struct bench_result *res)
+{
+	struct bench_fb fb = {
+		.width = mode->width,
+		.height = mode->height,
+		.pitch = mode->width * sizeof(u32),
+	};
+	struct bench_encoder enc = { };
+	struct drm_rect clips[BENCH_MAX_CLIPS];
+	struct drm_rect all = DRM_RECT_INIT(0, 0, fb.width, fb.height);
+	unsigned int num_clips, n;
+	u64 bytes = 0, elapsed = 0, start;
+
+	fb.pixels = malloc((size_t)fb.height * fb.pitch);
+	if (!fb.pixels) {
+		perror("malloc");
+		exit(1);
+	}
+
+	bench_seed = 0x2545f491;
+	bench_fill_background(&fb, &all);
+	*ms912x_param_shadow = shadow_mode;
+
+	/* The first frame is sent in full and is not measured */
+	bench_send_frame(&enc, &fb, clips, 0);
+	enc.convert_ns = 0;
+	enc.converted = 0;
+
+	for (n = 0; n < frames; n++) {
+		scenario->frame(&fb, n, clips, &num_clips);
+		start = bench_now_ns();
+		bytes += bench_send_frame(&enc, &fb, clips, num_clips);
+		elapsed += bench_now_ns() - start;
+	}
+
+	snprintf(res->key, sizeof(res->key), "%s/%s/%dx%d@%d", scenario->name,
+		 bench_shadow_names[shadow_mode], mode->width, mode->height,
+		 mode->hz);
+	res->ns_px = enc.converted ? (double)enc.convert_ns / enc.converted : 0;
+	res->us_frame = (double)elapsed / frames / 1000;
+	res->bytes_frame = bytes / frames;
+
+	ms912x_shadow_free(&enc.shadow);
+	free(enc.buf);
+	free(fb.pixels);
+}
+
+struct bench_variant {
+	const char *name;
+	ms912x_line_fn fn;
+};
+
+static unsigned int bench_variants(struct bench_variant *v)
+{
+	unsigned int n = 0;
+
+	v[n++] = (struct bench_variant){ "c", ms912x_xrgb8888_to_uyvy_line_c };
+#if defined(CONFIG_X86)
+	if (__builtin_cpu_supports("sse2"))
+		v[n++] = (struct bench_variant){
+			"sse2", ms912x_xrgb8888_to_uyvy_line_sse2 };
+	if (__builtin_cpu_supports("avx2"))
+		v[n++] = (struct bench_variant){
+			"avx2", ms912x_xrgb8888_to_uyvy_line_avx2 };
+#elif defined(CONFIG_ARM64)
+	v[n++] = (struct bench_variant){ "neon",
+					 ms912x_xrgb8888_to_uyvy_line_neon };
+#endif
+	return n;
+}
+
+/*
+ * Raw conversion speed of every kernel on a full frame of noise.  Also
+ * checks that the SIMD kernels match the scalar reference.
+ */
+static int bench_run_convert(const struct bench_variant *variant,
+			     const struct bench_mode *mode,
+			     unsigned int frames, struct bench_result *res)
+{
+	size_t pixels = (size_t)mode->width * mode->height;
+	u32 *src = malloc(pixels * sizeof(u32));
+	u8 *dst = malloc(pixels * MS912X_UYVY_BPP);
+	u8 *ref = malloc(pixels * MS912X_UYVY_BPP);
+	unsigned int n;
+	int y, ret = 0;
+	u64 start;
+	size_t i;
+
+	if (!src || !dst || !ref) {
+		perror("malloc");
+		exit(1);
+	}
+
+	bench_seed = 0x9e3779b9;
+	for (i = 0; i < pixels; i++)
+		src[i] = bench_random();
+
+	start = bench_now_ns();
+	for (n = 0; n < frames; n++)
+		for (y = 0; y < mode->height; y++)
+			variant->fn(dst + (size_t)y * mode->width * 2,
+				    src + (size_t)y * mode->width,
+				    mode->width);
+	res->ns_px = (double)(bench_now_ns() - start) / frames / pixels;
+	res->us_frame = res->ns_px * pixels / 1000;
+	res->bytes_frame = pixels * MS912X_UYVY_BPP;
+	snprintf(res->key, sizeof(res->key), "convert/%s/%dx%d",
+		 variant->name, mode->width, mode->height);
+
+	for (y = 0; y < mode->height; y++)
+		ms912x_xrgb8888_to_uyvy_line_c(ref + (size_t)y * mode->width * 2,
+					       src + (size_t)y * mode->width,
+					       mode->width);
+	if (memcmp(dst, ref, pixels * MS912X_UYVY_BPP)) {
+		fprintf(stderr, "%s: output differs from the scalar code\n",
+			variant->name);
+		ret = -1;
+	}
+
+	free(src);
+	free(dst);
+	free(ref);
+	return ret;
+}
+
+static struct bench_result *bench_baseline;
+static unsigned int bench_baseline_len;
+
+static void bench_load_baseline(const char *path)
+{
+	struct bench_result r;
+	unsigned int cap = 0;
+	char line[256];
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "%63s %lf %lf %llu", r.key, &r.ns_px,
+			   &r.us_frame, &r.bytes_frame) != 4)
+			continue;
+		if (bench_baseline_len == cap) {
+			cap = cap ? cap * 2 : 64;
+			bench_baseline = realloc(bench_baseline,
+						 cap * sizeof(r));
+			if (!bench_baseline) {
+				perror("realloc");
+				exit(1);
+			}
+		}
+		bench_baseline[bench_baseline_len++] = r;
+	}
+	fclose(f);
+}
+
+static const struct bench_result *bench_find_baseline(const char *key)
+{
+	unsigned int i;
+
+	for (i = 0; i < bench_baseline_len; i++)
+		if (!strcmp(bench_baseline[i].key, key))
+			return &bench_baseline[i];
+	return NULL;
+}
+
+/*
+ * Prints one result and compares it to the baseline.  Byte counts are
+ * deterministic and must not grow.  Times only count when @tolerance is not
+ * negative, as the allowed slowdown in percent; they are too noisy on shared
+ * machines to fail on by default.
+ * Returns true on a regression.
+ */
+static bool bench_report(const struct bench_result *res, FILE *out,
+			 double tolerance)
+{
+	const struct bench_result *base = bench_find_baseline(res->key);
+	bool regressed = false;
+	double delta;
+
+	printf("%-34s %8.3f %10.1f %12llu", res->key, res->ns_px,
+	       res->us_frame, res->bytes_frame);
+	if (out)
+		fprintf(out, "%s %.3f %.1f %llu\n", res->key, res->ns_px,
+			res->us_frame, res->bytes_frame);
+
+	if (!base) {
+		printf("\n");
+		return false;
+	}
+
+	delta = base->us_frame ?
+		(res->us_frame - base->us_frame) * 100 / base->us_frame : 0;
+	regressed = (tolerance >= 0 && delta > tolerance) ||
+		    res->bytes_frame > base->bytes_frame;
+	printf(" %+7.1f%%%s%s\n", delta,
+	       res->bytes_frame != base->bytes_frame ? " bytes changed" : "",
+	       regressed ? " REGRESSION" : "");
+	return regressed;
+}
+
+static void bench_usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [-n frames] [-f filter] [-b baseline] [-o output] [-t tolerance]\n"
+		"  -n  frames per workload (default: 16)\n"
+		"  -f  only run workloads whose name contains this string\n"
+		"  -b  compare against a stored baseline, fail on regressions\n"
+		"  -o  write the results in baseline format\n"
+		"  -t  also fail when slower than the baseline by this many percent\n",
+		argv0);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	static const enum ms912x_shadow_mode shadow_modes[] = {
+		MS912X_SHADOW_OFF, MS912X_SHADOW_FRAME, MS912X_SHADOW_CHECKSUM,
+	};
+	const struct bench_mode convert_mode = { 1920, 1080, 60 };
+	struct bench_variant variants[4];
+	unsigned int frames = 16, num_variants, i, m, s, sc;
+	const char *filter = NULL, *baseline = NULL, *output = NULL;
+	double tolerance = -1;
+	struct bench_result res;
+	unsigned int regressions = 0;
+	bool failed = false;
+	FILE *out = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:f:b:o:t:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			frames = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			filter = optarg;
+			break;
+		case 'b':
+			baseline = optarg;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 't':
+			tolerance = strtod(optarg, NULL);
+			break;
+		default:
+			bench_usage(argv[0]);
+		}
+	}
+	if (!frames)
+		bench_usage(argv[0]);
+
+	if (baseline)
+		bench_load_baseline(baseline);
+	if (output) {
+		out = fopen(output, "w");
+		if (!out) {
+			fprintf(stderr, "%s: %s\n", output, strerror(errno));
+			return 1;
+		}
+		fprintf(out, "# key ns/px us/frame bytes/frame\n");
+	}
+
+	printf("# dispatcher uses %s conversion, %u frames per workload\n",
+	       ms912x_convert_init(), frames);
+	printf("%-34s %8s %10s %12s\n", "# workload", "ns/px", "us/frame",
+	       "bytes/frame");
+
+	num_variants = bench_variants(variants);
+	for (i = 0; i < num_variants; i++) {
+		snprintf(res.key, sizeof(res.key), "convert/%s/%dx%d",
+			 variants[i].name, convert_mode.width,
+			 convert_mode.height);
+		if (filter && !strstr(res.key, filter))
+			continue;
+		if (bench_run_convert(&variants[i], &convert_mode, frames, &res))
+			failed = true;
+		regressions += bench_report(&res, out, tolerance);
+	}
+
+	for (sc = 0; sc < ARRAY_SIZE(bench_scenarios); sc++) {
+		for (s = 0; s < ARRAY_SIZE(shadow_modes); s++) {
+			for (m = 0; m < ARRAY_SIZE(bench_modes); m++) {
+				snprintf(res.key, sizeof(res.key),
+					 "%s/%s/%dx%d@%d",
+					 bench_scenarios[sc].name,
+					 bench_shadow_names[shadow_modes[s]],
+					 bench_modes[m].width,
+					 bench_modes[m].height,
+					 bench_modes[m].hz);
+				if (filter && !strstr(res.key, filter))
+					continue;
+
+				bench_run_scenario(&bench_scenarios[sc],
+						   &bench_modes[m],
+						   shadow_modes[s], frames,
+						   &res);
+				regressions += bench_report(&res, out,
+							    tolerance);
+			}
+		}
+	}
+
+	if (out)
+		fclose(out);
+
+	if (regressions)
+		printf("# %u regressions against %s\n", regressions, baseline);
+	return failed || regressions ? 1 : 0;
+}
@@ -0,0 +1,20 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* Userspace stand-in for the kernel header, see tools/bench/README.md */
+#ifndef MS912X_SHIM_ASM_CPUFEATURE_H
+#define MS912X_SHIM_ASM_CPUFEATURE_H
+
+#if defined(CONFIG_X86)
+#define X86_FEATURE_XMM2 "sse2"
+#define X86_FEATURE_AVX "avx"
+#define X86_FEATURE_AVX2 "avx2"
+#define boot_cpu_has(feature) __builtin_cpu_supports(feature)
+/* The OS saves the YMM state whenever the CPU reports AVX to userspace */
+#define XFEATURE_MASK_SSE 0
+#define XFEATURE_MASK_YMM 0
+#define cpu_has_xfeatures(mask, name) 1
+#elif defined(CONFIG_ARM64)
+/* Advanced SIMD is mandatory on arm64 */
+#define cpu_have_named_feature(feature) 1
+#endif
+
+#endif
@@ -0,0 +1,4 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* Userspace stand-in for the kernel header, see tools/bench/README.md */
+#define kernel_fpu_begin() do { } while (0)
+#define kernel_fpu_end() do { } while (0)
@@ -0,0 +1,3 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* Userspace stand-in for the kernel header, see tools/bench/README.md */
+#include <arm_neon.h>
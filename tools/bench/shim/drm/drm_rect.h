@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* Userspace stand-in for the kernel header, see tools/bench/README.md */
+#ifndef MS912X_SHIM_DRM_RECT_H
+#define MS912X_SHIM_DRM_RECT_H
+
+struct drm_rect {
+	int x1, y1, x2, y2;
+};
+
+#define DRM_RECT_INIT(x, y, w, h)                                              \
+	((struct drm_rect){ .x1 = (x), .y1 = (y), .x2 = (x) + (w),              \
+			    .y2 = (y) + (h) })
+
+static inline int drm_rect_width(const struct drm_rect *r)
+{
+	return r->x2 - r->x1;
+}
+
+static inline int drm_rect_height(const struct drm_rect *r)
+{
+	return r->y2 - r->y1;
+}
+
+static inline bool drm_rect_intersect(struct drm_rect *r1,
+				      const struct drm_rect *r2)
+{
+	r1->x1 = r1->x1 > r2->x1 ? r1->x1 : r2->x1;
+	r1->y1 = r1->y1 > r2->y1 ? r1->y1 : r2->y1;
+	r1->x2 = r1->x2 < r2->x2 ? r1->x2 : r2->x2;
+	r1->y2 = r1->y2 < r2->y2 ? r1->y2 : r2->y2;
+
+	return r1->x2 > r1->x1 && r1->y2 > r1->y1;
+}
+
+#endif
@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* Userspace stand-in for the kernel header, see tools/bench/README.md */
+#ifndef MS912X_SHIM_LINUX_MM_H
+#define MS912X_SHIM_LINUX_MM_H
+
+#include <stdlib.h>
+
+#include <linux/kernel.h>
+
+#define GFP_KERNEL 0
+
+static inline void *kvmalloc_array(size_t n, size_t size, int flags)
+{
+	if (size && n > SIZE_MAX / size)
+		return NULL;
+	return malloc(n * size);
+}
+
+static inline void kvfree(const void *p)
+{
+	free((void *)p);
+}
+
+#endif
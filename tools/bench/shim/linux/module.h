@@ -0,0 +1,14 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* Userspace stand-in for the kernel header, see tools/bench/README.md */
+#ifndef MS912X_SHIM_LINUX_MODULE_H
+#define MS912X_SHIM_LINUX_MODULE_H
+
+#include <linux/kernel.h>
+
+/* Module parameters become ms912x_param_<name> pointers the bench can set */
+#define module_param_named(name, value, type, perm)                            \
+	__typeof__(value) *ms912x_param_##name = &(value)
+#define module_param(name, type, perm) module_param_named(name, name, type, perm)
+#define MODULE_PARM_DESC(name, desc)
+
+#endif
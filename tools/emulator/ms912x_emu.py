@@ -0,0 +1,697 @@
+#!/usr/bin/env python3
+"""Software stand-in for an ms912x adapter, exported over USB/IP.
+
+The emulator answers the 0xb5/0xa6 HID report register protocol used by
+``ms912x_registers.c``, serves an EDID from 0xC000 and the connector status
+from ``MS912X_REG_STATUS``, and sinks the bulk OUT endpoint 0x04 at a
+configurable USB 2 or USB 3 bandwidth.  Every frame update it receives is
+decoded, validated and applied to an emulated framebuffer, which can be
+dumped as a PPM and compared against a reference image.
+
+Attach it to the local machine with the vhci-hcd driver::
+
+    sudo modprobe vhci-hcd
+    tools/emulator/ms912x_emu.py --speed high &
+    sudo usbip attach -r 127.0.0.1 -b 1-1
+
+SIGUSR1 toggles the connector status, SIGUSR2 dumps the framebuffer.
+"""
+
+from __future__ import annotations
+
+import argparse
+import collections
+import dataclasses
+import math
+import signal
+import socket
+import struct
+import sys
+import threading
+import time
+from dataclasses import dataclass
+from typing import Optional
+
+USBIP_VERSION = 0x0111
+OP_REQ_DEVLIST = 0x8005
+OP_REP_DEVLIST = 0x0005
+OP_REQ_IMPORT = 0x8003
+OP_REP_IMPORT = 0x0003
+
+USBIP_CMD_SUBMIT = 1
+USBIP_CMD_UNLINK = 2
+USBIP_RET_SUBMIT = 3
+USBIP_RET_UNLINK = 4
+USBIP_DIR_OUT = 0
+
+USB_SPEED_HIGH = 3
+USB_SPEED_SUPER = 5
+
+EPIPE = 32
+ECONNRESET = 104
+
+BUSID = "1-1"
+
+# Register map, see ms912x_regs.h
+REG_SET1 = 0x01
+REG_SET2 = 0x02
+REG_APPLY = 0x04
+REG_COMMIT = 0x05
+REG_POWER = 0x07
+REG_STATUS = 0x32
+REG_EDID_BASE = 0xC000
+REG_HACTIVE = 0xF384
+REG_VACTIVE = 0xF388
+
+BULK_EP = 0x04
+INT_EP = 0x83
+
+TILE_WIDTH = 16
+END_OF_UPDATE = bytes([0xFF, 0xC0, 0, 0, 0, 0, 0, 0])
+
+# Pixel formats of the resolution request, with their bytes per pixel
+PIXEL_FORMATS = {
+    0x2200: ("UYVY", 2),
+    0x1100: ("RGB", 3),
+}
+
+# Sustained bulk throughput, in MB/s
+BANDWIDTH = {
+    "high": 40.0,
+    "super": 380.0,
+}
+
+
+def default_edid() -> bytes:
+    """A single block EDID preferring 1920x1080@60."""
+
+    edid = bytearray(128)
+    edid[0:8] = b"\x00\xff\xff\xff\xff\xff\xff\x00"
+    edid[8:10] = b"\x36\x78"  # "MSX"
+    edid[10:12] = b"\x20\x91"
+    edid[12:16] = b"\x01\x00\x00\x00"
+    edid[16:20] = b"\x01\x22\x01\x03"  # week 1 of 2024, EDID 1.3
+    edid[20:25] = b"\x80\x35\x1e\x78\x0a"
+    edid[25:35] = b"\xee\x91\xa3\x54\x4c\x99\x26\x0f\x50\x54"
+    edid[35:38] = b"\x21\x08\x00"  # 640x480, 800x600, 1024x768 at 60 Hz
+    edid[38:54] = (b"\x81\xc0\x81\x80\xb3\x00\x95\x00"
+                   b"\x01\x01\x01\x01\x01\x01\x01\x01")
+    # 1920x1080@60, 148.5 MHz
+    edid[54:72] = bytes.fromhex("023a801871382d40582c4500132b21000018")
+    edid[72:90] = bytes.fromhex("000000fd00384c1e5311000a202020202020")
+    edid[90:108] = b"\x00\x00\x00\xfc\x00" + b"ms912x emu\n  "
+    edid[108:126] = b"\x00\x00\x00\x10" + bytes(14)
+    edid[127] = -sum(edid[:127]) & 0xFF
+    return bytes(edid)
+
+
+@dataclass
+class Stats:
+    """Counters since the last report."""
+
+    nbytes: int = 0
+    urbs: int = 0
+    updates: int = 0
+    pixels: int = 0
+    frames: int = 0
+    errors: int = 0
+    busy: float = 0.0
+    latency: float = 0.0
+
+
+class FrameDecoder:
+    """Parses the bulk stream into frame updates and applies them."""
+
+    def __init__(self, stats: Stats, verbose: bool) -> None:
+        self.stats = stats
+        self.verbose = verbose
+        self.width = 0
+        self.height = 0
+        self.stride = 0
+        self.bpp = 0
+        self.pixel_format = "none"
+        self.fb = bytearray()
+        self.buf = bytearray()
+        self.update: Optional[tuple[int, int, int, int]] = None
+
+    def set_mode(self, width: int, height: int, pixel_format: int) -> None:
+        name, bpp = PIXEL_FORMATS.get(pixel_format, ("unknown", 0))
+        self.width = width
+        self.height = height
+        self.bpp = bpp
+        self.pixel_format = name
+        self.stride = -(-width // TILE_WIDTH) * TILE_WIDTH * bpp
+        self.fb = bytearray(self.stride * height)
+        self.buf.clear()
+        self.update = None
+        print(f"mode {width}x{height} {name} (0x{pixel_format:04x})")
+
+    def error(self, msg: str) -> None:
+        self.stats.errors += 1
+        print(f"frame error: {msg}", file=sys.stderr)
+
+    def resync(self) -> None:
+        """Drops bytes up to the next possible update header."""
+
+        pos = self.buf.find(b"\xff\x00", 1)
+        del self.buf[:pos if pos > 0 else len(self.buf)]
+
+    def feed(self, data: bytes) -> None:
+        self.buf += data
+
+        while True:
+            if self.update is None:
+                if len(self.buf) < 8:
+                    return
+                if self.buf[0] != 0xFF or self.buf[1] != 0x00:
+                    self.error(f"bad header {self.buf[:8].hex()}")
+                    self.resync()
+                    continue
+
+                x = self.buf[2] * TILE_WIDTH
+                y = int.from_bytes(self.buf[3:5], "big")
+                w = self.buf[5] * TILE_WIDTH
+                h = int.from_bytes(self.buf[6:8], "big")
+                if not self.bpp:
+                    self.error(f"update in {self.pixel_format} mode")
+                    self.resync()
+                    continue
+                if (not w or not h or x + w > self.stride // self.bpp or
+                        y + h > self.height):
+                    self.error(f"update ({x},{y}) {w}x{h} outside "
+                               f"{self.width}x{self.height}")
+                    self.resync()
+                    continue
+
+                del self.buf[:8]
+                self.update = (x, y, w, h)
+
+            x, y, w, h = self.update
+            line = w * self.bpp
+            need = line * h + len(END_OF_UPDATE)
+            if len(self.buf) < need:
+                return
+
+            payload = memoryview(self.buf)
+            offset = y * self.stride + x * self.bpp
+            for row in range(h):
+                self.fb[offset:offset + line] = \
+                    payload[row * line:(row + 1) * line]
+                offset += self.stride
+            end = bytes(payload[need - len(END_OF_UPDATE):need])
+            payload.release()
+
+            if end != END_OF_UPDATE:
+                self.error(f"bad terminator {end.hex()} after "
+                           f"({x},{y}) {w}x{h}")
+            elif self.verbose:
+                print(f"update ({x},{y}) {w}x{h}")
+
+            del self.buf[:need]
+            self.update = None
+            self.stats.updates += 1
+            self.stats.pixels += w * h
+
+    def rgb(self) -> bytes:
+        """The visible part of the framebuffer as RGB, BT.601 limited."""
+
+        if self.pixel_format == "RGB":
+            line = self.width * 3
+            return b"".join(self.fb[y * self.stride:y * self.stride + line]
+                            for y in range(self.height))
+
+        out = bytearray(self.width * self.height * 3)
+        clip = bytes(min(max(v, 0), 255) for v in range(-1024, 1024))
+        o = 0
+        for y in range(self.height):
+            row = self.fb[y * self.stride:(y + 1) * self.stride]
+            for x in range(0, self.width, 2):
+                u, y0, v, y1 = row[x * 2:x * 2 + 4]
+                d = u - 128
+                e = v - 128
+                for luma in (y0, y1)[:self.width - x]:
+                    c = 298 * (luma - 16)
+                    out[o] = clip[((c + 409 * e + 128) >> 8) + 1024]
+                    out[o + 1] = clip[((c - 100 * d - 208 * e + 128) >> 8)
+                                      + 1024]
+                    out[o + 2] = clip[((c + 516 * d + 128) >> 8) + 1024]
+                    o += 3
+        return bytes(out)
+
+
+def read_ppm(path: str) -> tuple[int, int, bytes]:
+    with open(path, "rb") as f:
+        data = f.read()
+    fields = []
+    pos = 0
+    while len(fields) < 4:
+        while data[pos:pos + 1].isspace():
+            pos += 1
+        if data[pos:pos + 1] == b"#":
+            pos = data.index(b"\n", pos)
+            continue
+        start = pos
+        while not data[pos:pos + 1].isspace():
+            pos += 1
+        fields.append(data[start:pos])
+    if fields[0] != b"P6" or fields[3] != b"255":
+        raise ValueError(f"{path}: not an 8 bit binary PPM")
+    width, height = int(fields[1]), int(fields[2])
+    return width, height, data[pos + 1:pos + 1 + width * height * 3]
+
+
+class Device:
+    """Register file, descriptors and the connection to one host."""
+
+    def __init__(self, args: argparse.Namespace) -> None:
+        self.args = args
+        self.speed = USB_SPEED_SUPER if args.speed == "super" else \
+            USB_SPEED_HIGH
+        self.bandwidth = (args.bandwidth or BANDWIDTH[args.speed]) * 1e6
+        self.regs = bytearray(0x10000)
+        self.pending_read = 0
+        self.resolution = (0, 0, 0)
+        self.powered = False
+
+        edid = default_edid()
+        if args.edid:
+            with open(args.edid, "rb") as f:
+                edid = f.read()
+        self.regs[REG_EDID_BASE:REG_EDID_BASE + len(edid)] = edid
+        self.regs[REG_STATUS] = 0 if args.disconnected else 1
+
+        self.stats = Stats()
+        self.decoder = FrameDecoder(self.stats, args.verbose)
+
+        self.sock: Optional[socket.socket] = None
+        self.send_lock = threading.Lock()
+        self.cond = threading.Condition()
+        self.bulk: collections.deque = collections.deque()
+        self.current: Optional[int] = None
+        self.unlinked_by: Optional[int] = None
+        self.int_urb: Optional[tuple[int, bytes]] = None
+        self.bus_free = 0.0
+
+    # Descriptors
+
+    def device_descriptor(self) -> bytes:
+        vid, pid = self.args.id
+        super_speed = self.speed == USB_SPEED_SUPER
+        return struct.pack("<BBHBBBBHHHBBBB", 18, 1,
+                           0x0320 if super_speed else 0x0200, 0, 0, 0,
+                           9 if super_speed else 64, vid, pid, 0x0100,
+                           1, 2, 3, 1)
+
+    def endpoint(self, address: int, attributes: int, maxp: int,
+                 interval: int) -> bytes:
+        desc = struct.pack("<BBBBHB", 7, 5, address, attributes, maxp,
+                           interval)
+        if self.speed == USB_SPEED_SUPER:
+            burst = 15 if attributes == 2 else 0
+            per_interval = maxp if attributes == 3 else 0
+            desc += struct.pack("<BBBBH", 6, 0x30, burst, 0, per_interval)
+        return desc
+
+    def config_descriptor(self) -> bytes:
+        super_speed = self.speed == USB_SPEED_SUPER
+        body = b""
+        # Interfaces 0-2 exist on the real device but the driver ignores
+        # them; vendor class so no other driver binds to them either
+        for number in range(3):
+            body += struct.pack("<BBBBBBBBB", 9, 4, number, 0, 0, 0xFF,
+                                0, 0, 0)
+
+        endpoints = self.endpoint(BULK_EP, 2, 1024 if super_speed else 512,
+                                  0)
+        if self.args.hotplug_ep:
+            endpoints += self.endpoint(INT_EP, 3, 8, 4)
+        body += struct.pack("<BBBBBBBBB", 9, 4, 3, 0,
+                            2 if self.args.hotplug_ep else 1, 0xFF, 0, 0, 0)
+        body += endpoints
+
+        return struct.pack("<BBHBBBBB", 9, 2, 9 + len(body), 4, 1, 0, 0x80,
+                           250) + body
+
+    def bos_descriptor(self) -> bytes:
+        usb2_ext = struct.pack("<BBBI", 7, 0x10, 0x02, 0x02)
+        ss_cap = struct.pack("<BBBBHBBH", 10, 0x10, 0x03, 0, 0x0E, 1, 0x0A,
+                             0x07FF)
+        caps = usb2_ext + ss_cap
+        return struct.pack("<BBHB", 5, 0x0F, 5 + len(caps), 2) + caps
+
+    def string_descriptor(self, index: int) -> Optional[bytes]:
+        if index == 0:
+            return struct.pack("<BBH", 4, 3, 0x0409)
+        strings = {1: "MacroSilicon", 2: "ms912x emulator", 3: "0001"}
+        if index not in strings:
+            return None
+        text = strings[index].encode("utf-16-le")
+        return struct.pack("<BB", 2 + len(text), 3) + text
+
+    def descriptor(self, value: int) -> Optional[bytes]:
+        kind, index = value >> 8, value & 0xFF
+        if kind == 1:
+            return self.device_descriptor()
+        if kind == 2:
+            return self.config_descriptor()
+        if kind == 3:
+            return self.string_descriptor(index)
+        if kind == 6 and self.speed == USB_SPEED_HIGH:
+            return struct.pack("<BBHBBBBBB", 10, 6, 0x0200, 0, 0, 0, 64, 1,
+                               0)
+        if kind == 15 and self.speed == USB_SPEED_SUPER:
+            return self.bos_descriptor()
+        return None
+
+    # Register protocol, see ms912x_registers.c
+
+    def set_report(self, data: bytes) -> None:
+        if len(data) < 8:
+            raise ValueError(f"short report {data.hex()}")
+        if data[0] == 0xB5:
+            self.pending_read = int.from_bytes(data[1:3], "big")
+        elif data[0] == 0xA6:
+            self.write_register(data[1], data[2:8])
+        else:
+            raise ValueError(f"unknown report {data.hex()}")
+
+    def get_report(self) -> bytes:
+        address = self.pending_read
+        values = bytes(self.regs[(address + i) & 0xFFFF] for i in range(5))
+        if self.args.no_burst:
+            values = values[:1] + bytes(4)
+        return bytes([0xB5, address >> 8, address & 0xFF]) + values
+
+    def write_register(self, address: int, data: bytes) -> None:
+        if self.args.verbose:
+            print(f"write {address:02x}: {data.hex()}")
+        if address == REG_SET1:
+            width, height, pixel_format = struct.unpack(">HHH", data)
+            self.resolution = (width, height, pixel_format)
+        elif address == REG_COMMIT and data[0] == 1:
+            width, height, pixel_format = self.resolution
+            # As read back from the real device, little endian
+            for reg, value in ((REG_HACTIVE - 2, width),
+                               (REG_HACTIVE, width),
+                               (REG_VACTIVE - 2, height),
+                               (REG_VACTIVE, height)):
+                self.regs[reg:reg + 2] = value.to_bytes(2, "little")
+            self.decoder.set_mode(width, height, pixel_format)
+        elif address == REG_POWER:
+            self.powered = data[0] == 1
+            print(f"power {'on' if self.powered else 'off'}")
+
+    def control(self, setup: bytes, data: bytes) -> tuple[int, bytes]:
+        request_type, request, value, index, length = \
+            struct.unpack("<BBHHH", setup)
+
+        if request_type == 0x80 and request == 6:
+            desc = self.descriptor(value)
+            if desc is None:
+                return -EPIPE, b""
+            return 0, desc[:length]
+        if request_type in (0x80, 0x81, 0x82) and request == 0:
+            return 0, b"\x00\x00"[:length]
+        if (request_type, request) in ((0x00, 9), (0x01, 11), (0x02, 1)):
+            return 0, b""
+        if request_type == 0x21 and request == 9:
+            self.set_report(data)
+            return 0, b""
+        if request_type == 0xA1 and request == 1:
+            return 0, self.get_report()[:length]
+
+        print(f"unhandled control request {setup.hex()}", file=sys.stderr)
+        return -EPIPE, b""
+
+    # USB/IP
+
+    def usb_device(self) -> bytes:
+        vid, pid = self.args.id
+        path = f"/sys/devices/platform/ms912x-emu/{BUSID}".encode()
+        return struct.pack(">256s32sIIIHHHBBBBBB", path, BUSID.encode(), 1, 2,
+                           self.speed, vid, pid, 0x0100, 0, 0, 0, 1, 1, 4)
+
+    def send(self, data: bytes) -> None:
+        with self.send_lock:
+            if self.sock:
+                self.sock.sendall(data)
+
+    def ret_submit(self, seqnum: int, status: int, data: bytes, actual: int,
+                   packets: int) -> None:
+        self.send(struct.pack(">IIIIIiiiii8s", USBIP_RET_SUBMIT, seqnum, 0, 0,
+                              0, status, actual, 0, packets, 0, b"") + data)
+
+    def ret_unlink(self, seqnum: int, status: int) -> None:
+        self.send(struct.pack(">IIIIIi24s", USBIP_RET_UNLINK, seqnum, 0, 0, 0,
+                              status, b""))
+
+    def hotplug(self) -> None:
+        self.regs[REG_STATUS] ^= 1
+        print("connected" if self.regs[REG_STATUS] else "disconnected")
+        with self.cond:
+            urb, self.int_urb = self.int_urb, None
+        if urb:
+            seqnum, packets = urb
+            self.ret_submit(seqnum, 0, b"\x01", 1, packets)
+
+    def bulk_worker(self) -> None:
+        """Completes bulk URBs at the emulated bus speed, in order."""
+
+        while True:
+            with self.cond:
+                while not self.bulk:
+                    self.cond.wait()
+                seqnum, data, packets, received = self.bulk.popleft()
+                self.current = seqnum
+                self.unlinked_by = None
+
+                start = max(time.monotonic(), self.bus_free)
+                self.bus_free = start + len(data) / self.bandwidth
+                while self.unlinked_by is None:
+                    remaining = self.bus_free - time.monotonic()
+                    if remaining <= 0:
+                        break
+                    self.cond.wait(remaining)
+                unlinked_by = self.unlinked_by
+                self.current = None
+                idle = not self.bulk
+
+            if unlinked_by is not None:
+                self.ret_unlink(unlinked_by, -ECONNRESET)
+                continue
+
+            self.decoder.feed(data)
+            self.stats.nbytes += len(data)
+            self.stats.urbs += 1
+            self.stats.busy += len(data) / self.bandwidth
+            self.stats.latency += time.monotonic() - received
+            # A frame ends when the bus drains at an update boundary
+            if idle and self.decoder.update is None:
+                self.stats.frames += 1
+            self.ret_submit(seqnum, 0, b"", len(data), packets)
+
+    def unlink(self, seqnum: int, target: int) -> None:
+        with self.cond:
+            for urb in self.bulk:
+                if urb[0] == target:
+                    self.bulk.remove(urb)
+                    break
+            else:
+                urb = None
+                if self.int_urb and self.int_urb[0] == target:
+                    urb, self.int_urb = self.int_urb, None
+                elif self.current == target:
+                    # The worker answers once it notices
+                    self.unlinked_by = seqnum
+                    self.cond.notify_all()
+                    return
+        self.ret_unlink(seqnum, -ECONNRESET if urb else 0)
+
+    def recv(self, length: int) -> bytes:
+        data = bytearray()
+        while len(data) < length:
+            chunk = self.sock.recv(length - len(data))
+            if not chunk:
+                raise ConnectionError("host disconnected")
+            data += chunk
+        return bytes(data)
+
+    def serve_urbs(self) -> None:
+        while True:
+            header = self.recv(48)
+            command, seqnum, _, direction, ep = struct.unpack(">IIIII",
+                                                              header[:20])
+            if command == USBIP_CMD_UNLINK:
+                target, = struct.unpack(">I", header[20:24])
+                self.unlink(seqnum, target)
+                continue
+            if command != USBIP_CMD_SUBMIT:
+                raise ConnectionError(f"unknown command {command}")
+
+            _, length, _, packets, _, setup = struct.unpack(">Iiiii8s",
+                                                            header[20:])
+            data = self.recv(length) if direction == USBIP_DIR_OUT else b""
+
+            if ep == 0:
+                try:
+                    status, reply = self.control(setup, data)
+                except ValueError as e:
+                    print(f"control error: {e}", file=sys.stderr)
+                    status, reply = -EPIPE, b""
+                actual = len(reply) if direction != USBIP_DIR_OUT else \
+                    len(data)
+                self.ret_submit(seqnum, status, reply, actual, packets)
+            elif ep == BULK_EP & 0x0F and direction == USBIP_DIR_OUT:
+                with self.cond:
+                    self.bulk.append((seqnum, data, packets,
+                                      time.monotonic()))
+                    self.cond.notify_all()
+            elif ep == INT_EP & 0x0F and self.args.hotplug_ep:
+                with self.cond:
+                    self.int_urb = (seqnum, packets)
+            else:
+                self.ret_submit(seqnum, -EPIPE, b"", 0, packets)
+
+    def serve(self, conn: socket.socket) -> None:
+        """Handles one USB/IP connection, from the handshake on."""
+
+        version, code, _ = struct.unpack(">HHI", self.recv_from(conn, 8))
+        if code == OP_REQ_DEVLIST:
+            conn.sendall(struct.pack(">HHII", USBIP_VERSION, OP_REP_DEVLIST,
+                                     0, 1) + self.usb_device() +
+                         b"".join(struct.pack(">BBBB", 0xFF, 0, 0, 0)
+                                  for _ in range(4)))
+            return
+        if code != OP_REQ_IMPORT:
+            print(f"unknown request {code:04x}", file=sys.stderr)
+            return
+
+        busid = self.recv_from(conn, 32).rstrip(b"\0").decode()
+        if busid != BUSID:
+            conn.sendall(struct.pack(">HHI", USBIP_VERSION, OP_REP_IMPORT, 1))
+            return
+        conn.sendall(struct.pack(">HHI", USBIP_VERSION, OP_REP_IMPORT, 0) +
+                     self.usb_device())
+        print(f"attached at {self.bandwidth / 1e6:.0f} MB/s")
+
+        with self.send_lock:
+            self.sock = conn
+        try:
+            self.serve_urbs()
+        except (ConnectionError, OSError) as e:
+            print(f"detached: {e}")
+        finally:
+            with self.send_lock:
+                self.sock = None
+            with self.cond:
+                self.bulk.clear()
+                self.int_urb = None
+
+    @staticmethod
+    def recv_from(conn: socket.socket, length: int) -> bytes:
+        data = bytearray()
+        while len(data) < length:
+            chunk = conn.recv(length - len(data))
+            if not chunk:
+                raise ConnectionError("host disconnected")
+            data += chunk
+        return bytes(data)
+
+    # Reporting
+
+    def report(self, interval: float) -> None:
+        while True:
+            time.sleep(interval)
+            s = dataclasses.replace(self.stats)
+            for f in dataclasses.fields(Stats):
+                setattr(self.stats, f.name, f.default)
+            if not s.urbs and not s.errors:
+                continue
+            latency = s.latency / s.urbs * 1000 if s.urbs else 0
+            print(f"{s.frames / interval:6.1f} fps "
+                  f"{s.updates / interval:7.1f} updates/s "
+                  f"{s.nbytes / interval / 1e6:7.2f} MB/s "
+                  f"bus {s.busy / interval * 100:5.1f}% "
+                  f"latency {latency:6.2f} ms "
+                  f"errors {s.errors}", flush=True)
+
+    def dump(self, path: str, reference: Optional[str]) -> None:
+        if not self.decoder.width:
+            print("no mode set, nothing to dump")
+            return
+        rgb = self.decoder.rgb()
+        with open(path, "wb") as f:
+            f.write(f"P6\n{self.decoder.width} {self.decoder.height}\n255\n"
+                    .encode() + rgb)
+        print(f"framebuffer written to {path}")
+        if reference:
+            self.compare(rgb, reference)
+
+    def compare(self, rgb: bytes, reference: str) -> None:
+        width, height, ref = read_ppm(reference)
+        if (width, height) != (self.decoder.width, self.decoder.height):
+            print(f"reference is {width}x{height}, framebuffer is "
+                  f"{self.decoder.width}x{self.decoder.height}")
+            return
+        worst = max(abs(a - b) for a, b in zip(rgb, ref))
+        # Chroma subsampling alone keeps this well above 30 dB
+        mse = sum((a - b) ** 2 for a, b in zip(rgb, ref)) / len(ref)
+        psnr = 10 * math.log10(255 ** 2 / mse) if mse else float("inf")
+        print(f"reference {reference}: PSNR {psnr:.1f} dB, "
+              f"max difference {worst}")
+
+
+def parse_id(text: str) -> tuple[int, int]:
+    vid, pid = text.split(":")
+    return int(vid, 16), int(pid, 16)
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", type=int, default=3240,
+                        help="USB/IP port (default: 3240)")
+    parser.add_argument("--speed", choices=BANDWIDTH, default="high",
+                        help="bus to emulate (default: high)")
+    parser.add_argument("--bandwidth", type=float,
+                        help="bulk throughput in MB/s (default: by speed)")
+    parser.add_argument("--id", type=parse_id, default=(0x534D, 0x6021),
+                        help="vendor:product (default: 534d:6021)")
+    parser.add_argument("--edid", help="binary EDID to serve at 0xC000")
+    parser.add_argument("--no-burst", action="store_true",
+                        help="return one register per read report")
+    parser.add_argument("--disconnected", action="store_true",
+                        help="start with no monitor connected")
+    parser.add_argument("--hotplug-ep", action="store_true",
+                        help="offer an interrupt endpoint for hotplug")
+    parser.add_argument("--dump", default="ms912x-emu.ppm",
+                        help="where SIGUSR2 and exit write the framebuffer")
+    parser.add_argument("--reference", help="PPM to compare dumps against")
+    parser.add_argument("--interval", type=float, default=1.0,
+                        help="seconds between statistics lines")
+    parser.add_argument("-v", "--verbose", action="store_true")
+    args = parser.parse_args()
+
+    device = Device(args)
+    signal.signal(signal.SIGUSR1, lambda *_: device.hotplug())
+    signal.signal(signal.SIGUSR2,
+                  lambda *_: device.dump(args.dump, args.reference))
+
+    threading.Thread(target=device.bulk_worker, daemon=True).start()
+    threading.Thread(target=device.report, args=(args.interval,),
+                     daemon=True).start()
+
+    server = socket.create_server(("", args.port), reuse_port=True)
+    print(f"exporting {BUSID} on port {args.port}")
+    try:
+        while True:
+            conn, _ = server.accept()
+            conn.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            with conn:
+                device.serve(conn)
+    except KeyboardInterrupt:
+        device.dump(args.dump, args.reference)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())